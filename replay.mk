@@ -0,0 +1,21 @@
+#
+# OpenGL呼び出しの再生ツール(src/replay.cpp)
+#   make -f replay.mk
+# TIPS:LinuxではGLFW 2.xとMesaの開発用パッケージを入れておく
+#
+
+CXXFLAGS = -O2 -std=c++11 -Iinclude -Isrc
+
+ifeq ($(shell uname -s),Darwin)
+LDLIBS = OSX/lib/libglfw.a -framework OpenGL -framework Cocoa -framework IOKit
+else
+LDLIBS = -lglfw -lGL -lpthread
+endif
+
+replay: src/replay.cpp src/co_glReplayer.hpp src/co_glCommand.hpp src/co_glExt.hpp src/co_defines.hpp
+	$(CXX) $(CXXFLAGS) -o $@ src/replay.cpp $(LDLIBS)
+
+clean:
+	rm -f replay
+
+.PHONY: clean
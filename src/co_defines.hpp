@@ -27,6 +27,15 @@
 #undef _VARIADIC_MAX
 #define _VARIADIC_MAX (10)
 
+// リンク済みシェーダーをキャッシュする(GL_ARB_get_program_binaryが使える時のみ)
+#define USE_PROGRAM_BINARY
+
+// GPUの処理時間を計測する(GL_ARB_timer_queryが使える時のみ)
+#define USE_GPU_TIMER
+
+// Release版でも処理時間の表示(P)とCSV出力(O)を使えるようにする
+#define USE_PROFILER
+
 // いくつかの余計な警告を表示しないようにする
 #pragma warning (disable:4244)
 #pragma warning (disable:4800)
@@ -77,4 +86,7 @@ typedef unsigned long  u_long;
 // ↓GameCenterのボタンをテスト
 // #define USE_GAMECENTER
 
+// ↓OpenGLの呼び出しを記録できるようにする(co_glRecorder.hpp)
+// #define USE_GL_RECORDER
+
 #endif
@@ -11,8 +11,15 @@
 #include <string>
 #include <unordered_map>
 #include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <picojson.h>
 #include <boost/noncopyable.hpp>
 #include "co_misc.hpp"
+#include "co_glState.hpp"
+#include "co_glRecorder.hpp"
 
 
 namespace ngs {
@@ -22,36 +29,35 @@ namespace ngs {
 
 
 class EasyShader : private boost::noncopyable {
+public:
+  // 前処理の対象
+  enum Target {
+    TARGET_ES2,
+    TARGET_GL,
+  };
+
+  // 前処理済みのソースとattribute/uniformの一覧
+  struct Packed {
+    std::string vsh;
+    std::string fsh;
+    std::vector<std::string> attribs;
+    std::vector<std::string> uniforms;
+    // #ifdef で特殊化されている
+    bool specialized;
+
+    Packed() :
+      specialized(false)
+    {}
+  };
+
+  
+private:
 	GLuint program_;
 	std::unordered_map<std::string, GLint> attribs_;
 	std::unordered_map<std::string, GLint> uniforms_;
 
   
-	GLuint compile(GLuint type, const std::string& source) {
-    // コメント除去
-    std::string text = removeComment(source);
-
-		// シェーダーの中のattributeとuniform変数をリストアップ
-		listupTokens(attribs_, text, "attribute");
-		listupTokens(uniforms_, text, "uniform");
-
-    // TODO:以下のコードはC++11のregexで書き換えられる
-#if (TARGET_OS_IPHONE)
-		// ES 2.0:floatの精度を指定
-		replaceString(text, "es_lowp;", "precision lowp float;");
-		replaceString(text, "es_mediump;", "precision mediump float;");
-		replaceString(text, "es_highp;", "precision highp float;");
-#else
-		// ES 2.0以外:要らない文字列を削除
-		replaceString(text, "es_lowp;", "");
-		replaceString(text, "es_mediump;", "");
-		replaceString(text, "es_highp;", "");
-
-		replaceString(text, "highp", "");
-		replaceString(text, "mediump", "");
-		replaceString(text, "lowp", "");
-#endif
-
+	GLuint compile(GLuint type, const std::string& text) {
 		GLuint shader = glCreateShader(type);
     // glShaderSource は char** を要求する
     const char* text_ptr = text.c_str();
@@ -74,12 +80,18 @@ class EasyShader : private boost::noncopyable {
 		return shader;
 	}
 
-	void setup(const std::string& v_source, const std::string& f_source) {
-		GLuint vertex_shader = compile(GL_VERTEX_SHADER, v_source);
-		GLuint fragment_shader = compile(GL_FRAGMENT_SHADER, f_source);
+  void link(const Packed& packed, const bool retrievable) {
+		GLuint vertex_shader = compile(GL_VERTEX_SHADER, packed.vsh);
+		GLuint fragment_shader = compile(GL_FRAGMENT_SHADER, packed.fsh);
 
 		glAttachShader(program_, vertex_shader);
 		glAttachShader(program_, fragment_shader);
+#if defined (USE_PROGRAM_BINARY)
+    // TIPS:リンク前に指定しておかないとバイナリを取り出せないドライバがある
+    if (retrievable) glProgramParameteri(program_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#else
+    (void)retrievable;
+#endif
 		glLinkProgram(program_);
 #ifdef _DEBUG
 		GLint status;
@@ -92,20 +104,6 @@ class EasyShader : private boost::noncopyable {
 			DOUT << "link error:" << log << std::endl;
 		}
 #endif
-		
-		// リストアップしたattributeとuniform変数をまとめて関連づけ
-		// FIXME:mapをforでまわすのはいくない
-    for (auto& it : attribs_) {
-			it.second = glGetAttribLocation(program_, it.first.c_str());
-			DOUT << "Attrib:" << it.first << " " << it.second << std::endl;
-			assert(it.second >= 0);
-    }
-		
-		for (auto& it : uniforms_) {
-			it.second = glGetUniformLocation(program_, it.first.c_str());
-			DOUT << "Uniform:" << it.first << " " << it.second << std::endl;
-			assert(it.second >= 0);
-		}
 
 		// リンクしたらもう要らない
 		if (vertex_shader) {
@@ -117,42 +115,206 @@ class EasyShader : private boost::noncopyable {
 			glDetachShader(program_, fragment_shader);
 			glDeleteShader(fragment_shader);
 		}
+  }
+
+	void setup(const Packed& packed, const std::string* cache_path) {
+#if defined (USE_PROGRAM_BINARY)
+    // ドライバとソースが同じならリンク済みのプログラムを使い回す
+    std::string binary_path;
+    if (cache_path && GLEW_ARB_get_program_binary) {
+      binary_path = binaryPath(*cache_path, packed);
+    }
+
+    if (binary_path.empty() || !loadBinary(binary_path)) {
+      link(packed, !binary_path.empty());
+      if (!binary_path.empty()) saveBinary(binary_path);
+    }
+#else
+    (void)cache_path;
+    link(packed, false);
+#endif
+#if defined (USE_GL_RECORDER)
+    GlRecorder::source(program_, packed.vsh, packed.fsh);
+#endif
+
+		// 一覧にあるattributeとuniform変数をまとめて関連づけ
+    for (const auto& name : packed.attribs) {
+      GLint location = glGetAttribLocation(program_, name.c_str());
+			DOUT << "Attrib:" << name << " " << location << std::endl;
+      // TIPS:特殊化した結果、使われなくなった変数は最適化で消える
+			assert(location >= 0 || packed.specialized);
+      attribs_.insert(std::unordered_map<std::string, GLint>::value_type(name, location));
+    }
+		
+    for (const auto& name : packed.uniforms) {
+      GLint location = glGetUniformLocation(program_, name.c_str());
+			DOUT << "Uniform:" << name << " " << location << std::endl;
+			assert(location >= 0 || packed.specialized);
+      uniforms_.insert(std::unordered_map<std::string, GLint>::value_type(name, location));
+    }
 	}
 
+#if defined (USE_PROGRAM_BINARY)
+  // ドライバの情報とソースからキャッシュのファイル名を決める
+  static std::string binaryPath(const std::string& cache_path, const Packed& packed) {
+    std::string key;
+    key += reinterpret_cast<const char*>(glGetString(GL_VENDOR));
+    key += reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    key += reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    key += packed.vsh;
+    key += packed.fsh;
+
+    std::ostringstream path;
+    path << cache_path << "shader_" << std::hex << std::setw(8) << std::setfill('0') << hashString(key) << ".bin";
+    return path.str();
+  }
+
+  bool loadBinary(const std::string& path) {
+    std::ifstream fs(path, std::ios::binary);
+    if (!fs) return false;
+
+    GLenum format;
+    fs.read(reinterpret_cast<char*>(&format), sizeof(format));
+    if (!fs) return false;
+    // TIPS:istreambuf_iteratorで読み切ってもeofbitは立たない
+    std::vector<char> binary((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+    if (binary.empty()) return false;
+
+    glProgramBinary(program_, format, &binary[0], static_cast<GLsizei>(binary.size()));
+
+    // ドライバが更新されていると失敗する→通常のコンパイルに戻る
+		GLint status;
+    glGetProgramiv(program_, GL_LINK_STATUS, &status);
+    DOUT << "Program binary:" << path << " " << (status == GL_TRUE) << std::endl;
+    return status == GL_TRUE;
+  }
+
+  void saveBinary(const std::string& path) const {
+		GLint length = 0;
+    glGetProgramiv(program_, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program_, length, &length, &format, &binary[0]);
+
+    std::ofstream fs(path, std::ios::binary);
+    if (!fs) return;
+    fs.write(reinterpret_cast<const char*>(&format), sizeof(format));
+    fs.write(&binary[0], length);
+  }
+#endif
+
+  static u_int hashString(const std::string& text) {
+    return hashBytes(text.data(), text.size());
+  }
+
+  static std::string packPath(const std::string& file, const Target target, const std::string& defines) {
+    std::string path = file;
+    for (const auto& name : splitDefines(defines)) {
+      path += "." + name;
+    }
+    return path + ((target == TARGET_ES2) ? ".es2.pack" : ".gl.pack");
+  }
+
+  // 前処理済みのファイルが元のソースから作られたか判定する値
+  static u_int sourceHash(const std::string& v_source, const std::string& f_source, const std::string& defines) {
+    std::string key = v_source;
+    key += '\0';
+    key += f_source;
+    for (const auto& name : splitDefines(defines)) {
+      key += '\0';
+      key += name;
+    }
+    return hashString(key);
+  }
+
+  static std::vector<std::string> splitDefines(const std::string& defines) {
+    std::istringstream stream(defines);
+    std::vector<std::string> names;
+    std::string name;
+    while (stream >> name) names.push_back(name);
+    return names;
+  }
+
+  // #ifdef #ifndef #else #endif を展開する
+  // specialized: 展開した箇所があればtrue
+  static std::string specialize(const std::string& text, const std::vector<std::string>& defines, bool& specialized) {
+    std::istringstream stream(text);
+    std::string result;
+    // 外側のブロックが有効かどうか
+    std::vector<bool> outer;
+    bool active = true;
+
+    std::string line;
+    while (std::getline(stream, line)) {
+      std::istringstream tokens(line);
+      std::string directive;
+      std::string name;
+      tokens >> directive >> name;
+
+      if ((directive == "#ifdef") || (directive == "#ifndef")) {
+        bool defined = std::find(defines.begin(), defines.end(), name) != defines.end();
+        outer.push_back(active);
+        active = active && (defined == (directive == "#ifdef"));
+        specialized = true;
+      }
+      else if (directive == "#else") {
+        assert(!outer.empty());
+        active = outer.back() && !active;
+      }
+      else if (directive == "#endif") {
+        assert(!outer.empty());
+        active = outer.back();
+        outer.pop_back();
+      }
+      else if (active) {
+        result += line + "\n";
+      }
+    }
+    assert(outer.empty());
+
+    return result;
+  }
+
+  
 public:
 	EasyShader(const std::string& v_source, const std::string& f_source) :
 		program_(glCreateProgram())
 	{
 		DOUT << "EasyShader()" << std::endl;
-		setup(v_source, f_source);
+		setup(pack(v_source, f_source, currentTarget()), nullptr);
 	}
 
-	explicit EasyShader(const std::string& file) :
+  // cache_path: リンク済みプログラムのキャッシュを置く場所
+	EasyShader(const Packed& packed, const std::string& cache_path) :
 		program_(glCreateProgram())
 	{
 		DOUT << "EasyShader()" << std::endl;
+		setup(packed, &cache_path);
+	}
 
-    // .vshを読み込む
-    std::string vsh_path = file + ".vsh";
-		std::ifstream vsh_fs(vsh_path);
-		assert(vsh_fs);
-		std::string v_source((std::istreambuf_iterator<char>(vsh_fs)), std::istreambuf_iterator<char>());
-
-    // .fshを読み込む
-    std::string fsh_path = file + ".fsh";
-		std::ifstream fsh_fs(fsh_path);
-		assert(fsh_fs);
-		std::string f_source((std::istreambuf_iterator<char>(fsh_fs)), std::istreambuf_iterator<char>());
-		
-		setup(v_source, f_source);
+	explicit EasyShader(const std::string& file) :
+		program_(glCreateProgram())
+	{
+		DOUT << "EasyShader()" << std::endl;
+		setup(readPacked(file), nullptr);
 	}
 
 	~EasyShader() {
-    glDeleteProgram(program_);
+    gl_state.deleteProgram(program_);
 	}
 
+  // プログラムを入れ替える
+  // TIPS:使う側が持っているshared_ptrはそのままで、特殊化した版に差し替えられる
+  void swap(EasyShader& other) {
+    std::swap(program_, other.program_);
+    attribs_.swap(other.attribs_);
+    uniforms_.swap(other.uniforms_);
+  }
+
   
-	void operator()() const { glUseProgram(program_); }
+	void operator()() const { gl_state.program(program_); }
 
 	GLint attrib(const std::string& name) const {
 		const auto it = attribs_.find(name);
@@ -182,6 +344,167 @@ public:
 	}
 
 
+  static Target currentTarget() {
+#if (TARGET_OS_IPHONE)
+    return TARGET_ES2;
+#else
+    return TARGET_GL;
+#endif
+  }
+  
+  static std::string readFile(const std::string& path) {
+		std::ifstream fs(path);
+		assert(fs);
+		return std::string((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+  }
+
+  // コメント除去と精度指定の置き換え
+  static std::string preprocess(const std::string& source, const Target target) {
+    std::string text = removeComment(source);
+
+    // TODO:以下のコードはC++11のregexで書き換えられる
+    if (target == TARGET_ES2) {
+      // ES 2.0:floatの精度を指定
+      replaceString(text, "es_lowp;", "precision lowp float;");
+      replaceString(text, "es_mediump;", "precision mediump float;");
+      replaceString(text, "es_highp;", "precision highp float;");
+    }
+    else {
+      // ES 2.0以外:要らない文字列を削除
+      replaceString(text, "es_lowp;", "");
+      replaceString(text, "es_mediump;", "");
+      replaceString(text, "es_highp;", "");
+
+      replaceString(text, "highp", "");
+      replaceString(text, "mediump", "");
+      replaceString(text, "lowp", "");
+    }
+    return text;
+  }
+
+  // ソースを前処理してattributeとuniform変数をリストアップ
+  // defines: 特殊化に使う名前を空白区切りで指定
+  static Packed pack(const std::string& v_source, const std::string& f_source, const Target target,
+                     const std::string& defines = std::string()) {
+    const auto names = splitDefines(defines);
+
+    Packed packed;
+    packed.vsh = specialize(preprocess(v_source, target), names, packed.specialized);
+    packed.fsh = specialize(preprocess(f_source, target), names, packed.specialized);
+
+    std::unordered_map<std::string, GLint> attribs;
+    std::unordered_map<std::string, GLint> uniforms;
+    listupTokens(attribs, packed.vsh, "attribute");
+    listupTokens(uniforms, packed.vsh, "uniform");
+    listupTokens(uniforms, packed.fsh, "uniform");
+    for (const auto& it : attribs) packed.attribs.push_back(it.first);
+    for (const auto& it : uniforms) packed.uniforms.push_back(it.first);
+
+    return packed;
+  }
+
+  // 前処理済みのファイルを書き出す
+  // source: 元のソースのハッシュ値
+  static void writePack(const Packed& packed, const u_int source, const std::string& path) {
+    picojson::array attribs;
+    for (const auto& name : packed.attribs) attribs.push_back(picojson::value(name));
+    picojson::array uniforms;
+    for (const auto& name : packed.uniforms) uniforms.push_back(picojson::value(name));
+
+    picojson::object obj;
+    obj["vsh"] = picojson::value(packed.vsh);
+    obj["fsh"] = picojson::value(packed.fsh);
+    obj["attribute"] = picojson::value(attribs);
+    obj["uniform"] = picojson::value(uniforms);
+    obj["specialized"] = picojson::value(packed.specialized);
+    obj["source"] = picojson::value(static_cast<double>(source));
+
+    std::ofstream fs(path);
+    if (fs) fs << picojson::value(obj);
+  }
+
+  // false:ファイルが無いか、元のソースが書き換えられている
+  static bool readPack(Packed& packed, const u_int source, const std::string& path) {
+    std::ifstream fs(path);
+    if (!fs) return false;
+
+    picojson::value json;
+    fs >> json;
+    if (!json.contains("source")
+        || (static_cast<u_int>(json.at("source").get<double>()) != source)) {
+      DOUT << "Shader pack is stale:" << path << std::endl;
+      return false;
+    }
+    packed.vsh = json.at("vsh").get<std::string>();
+    packed.fsh = json.at("fsh").get<std::string>();
+    for (const auto& name : json.at("attribute").get<picojson::array>()) {
+      packed.attribs.push_back(name.get<std::string>());
+    }
+    for (const auto& name : json.at("uniform").get<picojson::array>()) {
+      packed.uniforms.push_back(name.get<std::string>());
+    }
+    packed.specialized = json.at("specialized").get<bool>();
+    return true;
+  }
+
+  // .vsh/.fshと同じ場所に全ターゲット分の前処理済みファイルを書き出す
+  static void makePack(const std::string& file, const std::string& defines = std::string()) {
+    std::string v_source = readFile(file + ".vsh");
+    std::string f_source = readFile(file + ".fsh");
+
+    const u_int source = sourceHash(v_source, f_source, defines);
+    writePack(pack(v_source, f_source, TARGET_ES2, defines), source, packPath(file, TARGET_ES2, defines));
+    writePack(pack(v_source, f_source, TARGET_GL, defines), source, packPath(file, TARGET_GL, defines));
+  }
+
+  // 前処理済みのファイルがあればそちらを読む
+  // Debug版はソースを優先して、前処理済みのファイルを作り直す
+  // TIPS:Release版でもソースと食い違うファイルは使わない
+  static Packed readPacked(const std::string& file, const std::string& defines = std::string()) {
+    std::string v_source = readFile(file + ".vsh");
+    std::string f_source = readFile(file + ".fsh");
+#if !defined (_DEBUG)
+    Packed packed;
+    if (readPack(packed, sourceHash(v_source, f_source, defines), packPath(file, currentTarget(), defines))) return packed;
+#else
+    makePack(file, defines);
+#endif
+    return pack(v_source, f_source, currentTarget(), defines);
+  }
+
+  // 頂点あたりの演算量のおおよその見積もり
+  // 四則演算と組み込み関数を数える(pow, normalizeは重めに見る)
+  static u_int aluEstimate(const std::string& text) {
+    std::string::size_type pos = text.find("void main");
+    if (pos == std::string::npos) return 0;
+    const std::string body = text.substr(pos);
+
+    u_int cost = 0;
+    for (const auto c : body) {
+      if ((c == '+') || (c == '-') || (c == '*') || (c == '/')) cost += 1;
+    }
+
+    static const struct {
+      const char* name;
+      u_int cost;
+    } tbl[] = {
+      { "pow(",       3 },
+      { "normalize(", 3 },
+      { "dot(",       1 },
+      { "max(",       1 },
+      { "min(",       1 },
+    };
+    
+    for (const auto& func : tbl) {
+      std::string::size_type p = 0;
+      while ((p = body.find(func.name, p)) != std::string::npos) {
+        cost += func.cost;
+        p += 1;
+      }
+    }
+    return cost;
+  }
+  
   // 識別子をリストアップ
   static void listupTokens(std::unordered_map<std::string, GLint>& tokens,
                            const std::string& text, const std::string& keyword) {
@@ -18,6 +18,9 @@
 #include "co_view.hpp"
 #include "co_time.hpp"
 #include "co_glState.hpp"
+#include "co_streamBuffer.hpp"
+#include "co_profiler.hpp"
+#include "co_glRecorder.hpp"
 
 
 namespace ngs {
@@ -34,14 +37,26 @@ class Framework : private boost::noncopyable {
   
   Signal signal_;
 
-  View    view_;
-  GlState gl_state_;
+  View view_;
+
+  // 毎フレーム書き換える頂点データ用
+  StreamBuffer stream_buffer_;
 
   Time time_;
+  Profiler profiler_;
+#if defined (USE_GL_RECORDER)
+  GlRecorder gl_recorder_;
+#endif
 
   
 public:
-  Framework() {
+  enum {
+    STREAM_BUFFER_SIZE = 1024 * 512
+  };
+
+  Framework() :
+    stream_buffer_(STREAM_BUFFER_SIZE)
+  {
     DOUT << "Framework()" << std::endl;
   }
 
@@ -68,11 +83,21 @@ public:
   View& view() { return view_; }
   const View& view() const { return view_; }
 
-  GlState& glState() { return gl_state_; }
-  const GlState& glState() const { return gl_state_; }
+  // co_層のクラスからも使うため実体はグローバル
+  GlState& glState() { return gl_state; }
+  const GlState& glState() const { return gl_state; }
+
+  StreamBuffer& streamBuffer() { return stream_buffer_; }
 
   Time& time() { return time_; }
   const Time& time() const { return time_; }
+
+  Profiler& profiler() { return profiler_; }
+  const Profiler& profiler() const { return profiler_; }
+
+#if defined (USE_GL_RECORDER)
+  GlRecorder& glRecorder() { return gl_recorder_; }
+#endif
   
   virtual void update() = 0;
   virtual void draw() = 0;
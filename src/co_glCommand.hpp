@@ -0,0 +1,152 @@
+﻿
+#pragma once
+
+//
+// OpenGL呼び出しの記録形式
+// GlRecorderが書き出し、再生ツール(replay.cpp)が読み込む
+//
+// [識別子 "NGSGLREC"][版][命令の種類数][フレーム数][語数][本体]
+// 本体は [命令 | 引数の語数 << 8][フレーム先頭からの時刻(ナノ秒)][引数...] の並び
+// ポインタ引数がクライアント側のメモリを指す時は、直前のDATAがその中身
+//
+
+#include "co_defines.hpp"
+
+
+namespace ngs {
+
+struct GlCommand {
+  enum Command {
+    ENABLE,
+    DISABLE,
+    BLEND_FUNC,
+    BLEND_EQUATION,
+    DEPTH_MASK,
+    VIEWPORT,
+    CLEAR,
+    LINE_WIDTH,
+
+    USE_PROGRAM,
+    BIND_BUFFER,
+    BUFFER_DATA,
+    BUFFER_SUB_DATA,
+    ACTIVE_TEXTURE,
+    BIND_TEXTURE,
+    BIND_FRAMEBUFFER,
+
+    ENABLE_VERTEX_ATTRIB_ARRAY,
+    DISABLE_VERTEX_ATTRIB_ARRAY,
+    VERTEX_ATTRIB_POINTER,
+
+    UNIFORM_1I,
+    UNIFORM_1F,
+    UNIFORM_2F,
+    UNIFORM_3F,
+    UNIFORM_4F,
+    UNIFORM_3FV,
+    UNIFORM_4FV,
+    UNIFORM_MATRIX_3FV,
+    UNIFORM_MATRIX_4FV,
+
+    DRAW_ARRAYS,
+    DRAW_ELEMENTS,
+
+    // 以下は記録用の命令
+    // フレームの区切り
+    FRAME,
+    // [バイト数][中身...]
+    DATA,
+    // 描画直前のクライアント側の頂点配列(中身はDATA)
+    CLIENT_ARRAY,
+    // 初めて参照された時点のオブジェクト(中身はDATA)
+    BUFFER_OBJECT,
+    TEXTURE_OBJECT,
+    PROGRAM_OBJECT,
+    FRAMEBUFFER_OBJECT,
+
+    COMMAND_NUM
+  };
+
+  enum {
+    // ファイル形式の版
+    VERSION = 2,
+    // クライアント側のメモリを指すポインタ
+    // TIPS:アドレスは実行する度に変わるので記録しない
+    CLIENT_POINTER = 0xffffffff
+  };
+
+  struct Info {
+    const char* name;
+    // 引数の型 e:enum i:int u:uint f:float b:bool p:ポインタ
+    const char* signature;
+    // ドライバへ渡さなくても、以降の処理に影響しない
+    bool droppable;
+  };
+
+  static const Info& info(const Command command) {
+    static const Info info[] = {
+      { "glEnable",        "e",    true },
+      { "glDisable",       "e",    true },
+      { "glBlendFunc",     "ee",   true },
+      { "glBlendEquation", "e",    true },
+      { "glDepthMask",     "b",    true },
+      // TIPS:glGetIntegerv(GL_VIEWPORT)で読み返している箇所があるので渡す
+      { "glViewport",      "iiii", false },
+      { "glClear",         "e",    true },
+      { "glLineWidth",     "f",    true },
+
+      // TIPS:バインドと転送はロード時の処理と共有しているので渡す
+      { "glUseProgram",      "u",    true },
+      { "glBindBuffer",      "eu",   false },
+      { "glBufferData",      "eipe", false },
+      { "glBufferSubData",   "eiip", false },
+      { "glActiveTexture",   "e",    false },
+      { "glBindTexture",     "eu",   false },
+      { "glBindFramebuffer", "eu",   false },
+
+      { "glEnableVertexAttribArray",  "u",      true },
+      { "glDisableVertexAttribArray", "u",      true },
+      { "glVertexAttribPointer",      "uiebip", true },
+
+      { "glUniform1i",        "ii",    true },
+      { "glUniform1f",        "if",    true },
+      { "glUniform2f",        "iff",   true },
+      { "glUniform3f",        "ifff",  true },
+      { "glUniform4f",        "iffff", true },
+      { "glUniform3fv",       "iip",   true },
+      { "glUniform4fv",       "iip",   true },
+      { "glUniformMatrix3fv", "iibp",  true },
+      { "glUniformMatrix4fv", "iibp",  true },
+
+      { "glDrawArrays",   "eii",  true },
+      { "glDrawElements", "eiep", true },
+
+      { "frame",       "u",       false },
+      { "data",        "u",       false },
+      { "clientArray", "uiebi",   false },
+      { "buffer",      "uue",     false },
+      { "texture",     "uiieeee", false },
+      { "program",     "u",       false },
+      { "framebuffer", "uuii",    false },
+    };
+    return info[command];
+  }
+
+  // 頂点配列の要素1つ分のバイト数
+  static u_int typeSize(const GLenum type) {
+    switch (type) {
+    case GL_BYTE:
+    case GL_UNSIGNED_BYTE:
+      return 1;
+
+    case GL_SHORT:
+    case GL_UNSIGNED_SHORT:
+      return 2;
+
+    default:
+      return 4;
+    }
+  }
+};
+
+}
@@ -3,25 +3,190 @@
 
 // 
 // OpenGL拡張機能
+// USE_GL_RECORDER定義時は描画で使う関数を関数テーブル経由で呼び出す
 //
 
 
 namespace ngs {
 
+#if defined (USE_GL_RECORDER)
+
+#if defined (_MSC_VER)
+#define GL_FUNC_ENTRY GLAPIENTRY
+#else
+#define GL_FUNC_ENTRY
+#endif
+
+// 差し替え可能な関数テーブル
+// TIPS:ロード時に一度だけ呼ぶ関数は対象外(取得系も値が必要なので対象外)
+struct GlFunc {
+  void (GL_FUNC_ENTRY* enable)(GLenum);
+  void (GL_FUNC_ENTRY* disable)(GLenum);
+  void (GL_FUNC_ENTRY* blendFunc)(GLenum, GLenum);
+  void (GL_FUNC_ENTRY* blendEquation)(GLenum);
+  void (GL_FUNC_ENTRY* depthMask)(GLboolean);
+  void (GL_FUNC_ENTRY* viewport)(GLint, GLint, GLsizei, GLsizei);
+  void (GL_FUNC_ENTRY* clear)(GLbitfield);
+  void (GL_FUNC_ENTRY* lineWidth)(GLfloat);
+
+  void (GL_FUNC_ENTRY* useProgram)(GLuint);
+  void (GL_FUNC_ENTRY* bindBuffer)(GLenum, GLuint);
+  void (GL_FUNC_ENTRY* bufferData)(GLenum, GLsizeiptr, const GLvoid*, GLenum);
+  void (GL_FUNC_ENTRY* bufferSubData)(GLenum, GLintptr, GLsizeiptr, const GLvoid*);
+  void (GL_FUNC_ENTRY* activeTexture)(GLenum);
+  void (GL_FUNC_ENTRY* bindTexture)(GLenum, GLuint);
+  void (GL_FUNC_ENTRY* bindFramebuffer)(GLenum, GLuint);
+
+  void (GL_FUNC_ENTRY* enableVertexAttribArray)(GLuint);
+  void (GL_FUNC_ENTRY* disableVertexAttribArray)(GLuint);
+  void (GL_FUNC_ENTRY* vertexAttribPointer)(GLuint, GLint, GLenum, GLboolean, GLsizei, const GLvoid*);
+
+  void (GL_FUNC_ENTRY* uniform1i)(GLint, GLint);
+  void (GL_FUNC_ENTRY* uniform1f)(GLint, GLfloat);
+  void (GL_FUNC_ENTRY* uniform2f)(GLint, GLfloat, GLfloat);
+  void (GL_FUNC_ENTRY* uniform3f)(GLint, GLfloat, GLfloat, GLfloat);
+  void (GL_FUNC_ENTRY* uniform4f)(GLint, GLfloat, GLfloat, GLfloat, GLfloat);
+  void (GL_FUNC_ENTRY* uniform3fv)(GLint, GLsizei, const GLfloat*);
+  void (GL_FUNC_ENTRY* uniform4fv)(GLint, GLsizei, const GLfloat*);
+  void (GL_FUNC_ENTRY* uniformMatrix3fv)(GLint, GLsizei, GLboolean, const GLfloat*);
+  void (GL_FUNC_ENTRY* uniformMatrix4fv)(GLint, GLsizei, GLboolean, const GLfloat*);
+
+  void (GL_FUNC_ENTRY* drawArrays)(GLenum, GLint, GLsizei);
+  void (GL_FUNC_ENTRY* drawElements)(GLenum, GLsizei, GLenum, const GLvoid*);
+};
+
+// TIPS:下のマクロから参照するので、初期化前に呼ばれないように注意
+GlFunc gl_func;
+
+// ドライバの関数で埋める
+// TIPS:GLEWの関数ポインタはglewInit()の後で確定する
+void setupGlFunc(GlFunc& func) {
+  func.enable        = glEnable;
+  func.disable       = glDisable;
+  func.blendFunc     = glBlendFunc;
+  func.blendEquation = glBlendEquation;
+  func.depthMask     = glDepthMask;
+  func.viewport      = glViewport;
+  func.clear         = glClear;
+  func.lineWidth     = glLineWidth;
+
+  func.useProgram      = glUseProgram;
+  func.bindBuffer      = glBindBuffer;
+  func.bufferData      = glBufferData;
+  func.bufferSubData   = glBufferSubData;
+  func.activeTexture   = glActiveTexture;
+  func.bindTexture     = glBindTexture;
+  func.bindFramebuffer = glBindFramebuffer;
+
+  func.enableVertexAttribArray  = glEnableVertexAttribArray;
+  func.disableVertexAttribArray = glDisableVertexAttribArray;
+  func.vertexAttribPointer      = glVertexAttribPointer;
+
+  func.uniform1i        = glUniform1i;
+  func.uniform1f        = glUniform1f;
+  func.uniform2f        = glUniform2f;
+  func.uniform3f        = glUniform3f;
+  func.uniform4f        = glUniform4f;
+  func.uniform3fv       = glUniform3fv;
+  func.uniform4fv       = glUniform4fv;
+  func.uniformMatrix3fv = glUniformMatrix3fv;
+  func.uniformMatrix4fv = glUniformMatrix4fv;
+
+  func.drawArrays   = glDrawArrays;
+  func.drawElements = glDrawElements;
+}
+
+#endif
+
 #if defined (_MSC_VER)
 
 // 初期化
 // false: 拡張機能は使えない
 bool initGlExt() {
   GLenum result_code = glewInit();
+#if defined (USE_GL_RECORDER)
+  setupGlFunc(gl_func);
+#endif
   return result_code == GLEW_OK;
 }
 
 #else
 
 // OSX, iOSでは必ず使える
-bool initGlExt() { return true; }
+bool initGlExt() {
+#if defined (USE_GL_RECORDER)
+  setupGlFunc(gl_func);
+#endif
+  return true;
+}
 
 #endif
 
 }
+
+
+#if defined (USE_GL_RECORDER)
+
+// 以降のコードのOpenGL呼び出しを関数テーブルへ向ける
+// TIPS:GLEWは関数をマクロで定義しているので、一旦取り消す
+#undef glEnable
+#undef glDisable
+#undef glBlendFunc
+#undef glBlendEquation
+#undef glDepthMask
+#undef glViewport
+#undef glClear
+#undef glLineWidth
+#undef glUseProgram
+#undef glBindBuffer
+#undef glBufferData
+#undef glBufferSubData
+#undef glActiveTexture
+#undef glBindTexture
+#undef glBindFramebuffer
+#undef glEnableVertexAttribArray
+#undef glDisableVertexAttribArray
+#undef glVertexAttribPointer
+#undef glUniform1i
+#undef glUniform1f
+#undef glUniform2f
+#undef glUniform3f
+#undef glUniform4f
+#undef glUniform3fv
+#undef glUniform4fv
+#undef glUniformMatrix3fv
+#undef glUniformMatrix4fv
+#undef glDrawArrays
+#undef glDrawElements
+
+#define glEnable                   ngs::gl_func.enable
+#define glDisable                  ngs::gl_func.disable
+#define glBlendFunc                ngs::gl_func.blendFunc
+#define glBlendEquation            ngs::gl_func.blendEquation
+#define glDepthMask                ngs::gl_func.depthMask
+#define glViewport                 ngs::gl_func.viewport
+#define glClear                    ngs::gl_func.clear
+#define glLineWidth                ngs::gl_func.lineWidth
+#define glUseProgram               ngs::gl_func.useProgram
+#define glBindBuffer               ngs::gl_func.bindBuffer
+#define glBufferData               ngs::gl_func.bufferData
+#define glBufferSubData            ngs::gl_func.bufferSubData
+#define glActiveTexture            ngs::gl_func.activeTexture
+#define glBindTexture              ngs::gl_func.bindTexture
+#define glBindFramebuffer          ngs::gl_func.bindFramebuffer
+#define glEnableVertexAttribArray  ngs::gl_func.enableVertexAttribArray
+#define glDisableVertexAttribArray ngs::gl_func.disableVertexAttribArray
+#define glVertexAttribPointer      ngs::gl_func.vertexAttribPointer
+#define glUniform1i                ngs::gl_func.uniform1i
+#define glUniform1f                ngs::gl_func.uniform1f
+#define glUniform2f                ngs::gl_func.uniform2f
+#define glUniform3f                ngs::gl_func.uniform3f
+#define glUniform4f                ngs::gl_func.uniform4f
+#define glUniform3fv               ngs::gl_func.uniform3fv
+#define glUniform4fv               ngs::gl_func.uniform4fv
+#define glUniformMatrix3fv         ngs::gl_func.uniformMatrix3fv
+#define glUniformMatrix4fv         ngs::gl_func.uniformMatrix4fv
+#define glDrawArrays               ngs::gl_func.drawArrays
+#define glDrawElements             ngs::gl_func.drawElements
+
+#endif
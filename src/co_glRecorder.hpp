@@ -0,0 +1,874 @@
+﻿
+#pragma once
+
+//
+// OpenGL呼び出しの記録
+// 関数テーブルを差し替えて、呼び出しの回数・時刻・引数を記録する
+// nullを指定すると描画だけに関わる呼び出しをドライバへ渡さず、CPU側の負荷だけを計れる
+// null以外では、参照されたオブジェクトと引数が指すメモリの中身も残し、再生ツールで再現できる
+// TIPS:USE_GL_RECORDER定義時のみ有効(co_glExt.hpp)
+//
+
+#include "co_defines.hpp"
+
+#if defined (USE_GL_RECORDER)
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <boost/noncopyable.hpp>
+#include "co_glCommand.hpp"
+
+
+namespace ngs {
+
+class GlRecorder : private GlCommand, private boost::noncopyable {
+public:
+  enum {
+    // 検証で有効とみなす頂点属性の番号の上限
+    VERTEX_ATTRIB_MAX = 16,
+    // 内容を残しておく警告の数
+    WARNING_MAX = 32
+  };
+
+  
+private:
+  bool active_;
+  bool null_;
+  // 記録するフレーム数と、記録したフレーム数
+  u_int frames_;
+  u_int frame_;
+  std::string path_;
+
+  // ドライバの関数
+  GlFunc real_;
+
+  // 形式はco_glCommand.hpp
+  std::vector<u_int> stream_;
+  double frame_start_;
+  // DRAWにかかった時間(ミリ秒)
+  std::vector<float> frame_time_;
+
+  u_int count_[COMMAND_NUM];
+  u_int errors_[COMMAND_NUM];
+  u_int warning_num_;
+  std::vector<std::string> warnings_;
+
+  // 検証用に追いかける状態
+  GLuint program_;
+  GLuint array_buffer_;
+  GLuint element_array_buffer_;
+
+  // クライアント側の頂点配列
+  struct ClientArray {
+    const GLvoid* pointer;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLsizei stride;
+  };
+  ClientArray client_[VERTEX_ATTRIB_MAX];
+  u_int attrib_enabled_;
+
+  // 中身を記録済みのオブジェクト
+  std::unordered_set<GLuint> buffers_;
+  std::unordered_set<GLuint> textures_;
+  std::unordered_set<GLuint> programs_;
+  std::unordered_set<GLuint> framebuffers_;
+
+  struct Source {
+    std::string vsh;
+    std::string fsh;
+  };
+
+
+  // TIPS:差し替えた関数から参照する
+  static GlRecorder*& current() {
+    static GlRecorder* recorder = 0;
+    return recorder;
+  }
+
+  // TIPS:リンク済みのプログラムからはソースを取り出せないので、生成時に教えてもらう
+  static std::unordered_map<GLuint, Source>& sources() {
+    static std::unordered_map<GLuint, Source> sources;
+    return sources;
+  }
+
+  static u_int fword(const GLfloat value) {
+    u_int word;
+    std::memcpy(&word, &value, sizeof(word));
+    return word;
+  }
+
+  // バッファがバインドされていればオフセット
+  static u_int pword(const GLuint bound, const GLvoid* pointer) {
+    if (bound) return static_cast<u_int>(reinterpret_cast<size_t>(pointer));
+    return pointer ? static_cast<u_int>(CLIENT_POINTER) : 0u;
+  }
+
+  // 記録して、ドライバへ渡すならtrue
+  bool call(const Command command, const u_int* args, const u_int num) {
+    stream_.push_back(command | (num << 8));
+    stream_.push_back(static_cast<u_int>((glfwGetTime() - frame_start_) * 1000000000.0));
+    stream_.insert(stream_.end(), args, args + num);
+    count_[command] += 1;
+
+    return !(null_ && info(command).droppable);
+  }
+
+  // 直後の命令が参照するメモリの中身
+  void data(const GLvoid* pointer, const size_t bytes) {
+    const u_int words = static_cast<u_int>((bytes + 3) / 4);
+    const u_int args[] = { static_cast<u_int>(bytes) };
+    call(DATA, args, ELEMSOF(args));
+    stream_[stream_.size() - 3] += words << 8;
+
+    const size_t offset = stream_.size();
+    stream_.resize(offset + words, 0);
+    if (bytes > 0) std::memcpy(&stream_[offset], pointer, bytes);
+  }
+
+  // 初めてバインドされたバッファの中身を残す
+  // TIPS:バインドした後に呼ぶ
+  void snapshotBuffer(const GLenum target, const GLuint id) {
+    if (null_ || !id || !buffers_.insert(id).second) return;
+
+    GLint size  = 0;
+    GLint usage = GL_STATIC_DRAW;
+    glGetBufferParameteriv(target, GL_BUFFER_SIZE, &size);
+    glGetBufferParameteriv(target, GL_BUFFER_USAGE, &usage);
+    std::vector<u_char> contents(size);
+    if (size > 0) glGetBufferSubData(target, 0, size, &contents[0]);
+
+    data(contents.empty() ? 0 : &contents[0], contents.size());
+    const u_int args[] = { id, static_cast<u_int>(size), static_cast<u_int>(usage) };
+    call(BUFFER_OBJECT, args, ELEMSOF(args));
+  }
+
+  // テクスチャはRGBAで読み出す
+  void snapshotTexture(const GLuint id) {
+    if (null_ || !id || !textures_.insert(id).second) return;
+
+    GLint current;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &current);
+    real_.bindTexture(GL_TEXTURE_2D, id);
+
+    GLint width  = 0;
+    GLint height = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    GLint param[4];
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &param[0]);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &param[1]);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, &param[2]);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, &param[3]);
+    std::vector<u_char> pixels(width * height * 4);
+    if (!pixels.empty()) glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+
+    real_.bindTexture(GL_TEXTURE_2D, current);
+
+    data(pixels.empty() ? 0 : &pixels[0], pixels.size());
+    const u_int args[] = {
+      id, static_cast<u_int>(width), static_cast<u_int>(height),
+      static_cast<u_int>(param[0]), static_cast<u_int>(param[1]), static_cast<u_int>(param[2]), static_cast<u_int>(param[3])
+    };
+    call(TEXTURE_OBJECT, args, ELEMSOF(args));
+  }
+
+  // ソースと、attribute/uniform変数の位置
+  // [頂点シェーダー]\0[フラグメントシェーダー]\0 に "a 位置 名前\0" "u 位置 名前\0" が続く
+  void snapshotProgram(const GLuint id) {
+    if (null_ || !id || !programs_.insert(id).second) return;
+
+    std::string text;
+    const auto it = sources().find(id);
+    if (it != sources().end()) {
+      text += it->second.vsh + '\0' + it->second.fsh + '\0';
+    }
+    else {
+      warn(USE_PROGRAM, "no shader source");
+      text += std::string(2, '\0');
+    }
+
+    GLint length;
+    glGetProgramiv(id, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &length);
+    std::vector<char> name(std::max(length, 1));
+    GLint num;
+    glGetProgramiv(id, GL_ACTIVE_ATTRIBUTES, &num);
+    for (GLint i = 0; i < num; ++i) {
+      GLint size;
+      GLenum type;
+      glGetActiveAttrib(id, i, static_cast<GLsizei>(name.size()), 0, &size, &type, &name[0]);
+      std::ostringstream entry;
+      entry << "a " << glGetAttribLocation(id, &name[0]) << " " << &name[0] << '\0';
+      text += entry.str();
+    }
+
+    glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &length);
+    name.resize(std::max(length, 1));
+    glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &num);
+    for (GLint i = 0; i < num; ++i) {
+      GLint size;
+      GLenum type;
+      glGetActiveUniform(id, i, static_cast<GLsizei>(name.size()), 0, &size, &type, &name[0]);
+      std::ostringstream entry;
+      entry << "u " << glGetUniformLocation(id, &name[0]) << " " << &name[0] << '\0';
+      text += entry.str();
+    }
+
+    data(text.data(), text.size());
+    const u_int args[] = { id };
+    call(PROGRAM_OBJECT, args, ELEMSOF(args));
+  }
+
+  // 描画先のテクスチャと大きさ
+  // TIPS:バインドした後に呼ぶ
+  void snapshotFramebuffer(const GLuint id) {
+    if (null_ || !id || !framebuffers_.insert(id).second) return;
+
+    GLint texture = 0;
+    glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &texture);
+    snapshotTexture(texture);
+
+    GLint current;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &current);
+    real_.bindTexture(GL_TEXTURE_2D, texture);
+    GLint width  = 0;
+    GLint height = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    real_.bindTexture(GL_TEXTURE_2D, current);
+
+    const u_int args[] = { id, static_cast<u_int>(texture), static_cast<u_int>(width), static_cast<u_int>(height) };
+    call(FRAMEBUFFER_OBJECT, args, ELEMSOF(args));
+  }
+
+  // 描画で使われるクライアント側の頂点配列の中身を残す
+  void captureClientArrays(const GLint first, const GLsizei count) {
+    if (null_) return;
+
+    for (u_int i = 0; i < VERTEX_ATTRIB_MAX; ++i) {
+      const ClientArray& array = client_[i];
+      if (!(attrib_enabled_ & (1 << i)) || !array.pointer) continue;
+
+      const u_int stride = array.stride ? array.stride : array.size * typeSize(array.type);
+      data(array.pointer, (first + count) * stride);
+      const u_int args[] = {
+        i, static_cast<u_int>(array.size), array.type, array.normalized, static_cast<u_int>(array.stride)
+      };
+      call(CLIENT_ARRAY, args, ELEMSOF(args));
+    }
+  }
+
+  // TIPS:nullの時は何も発行していないので調べない
+  void checkError(const Command command) {
+    if (null_) return;
+
+    const GLenum error = glGetError();
+    if (error == GL_NO_ERROR) return;
+
+    errors_[command] += 1;
+    std::ostringstream message;
+    message << "error 0x" << std::hex << error;
+    warn(command, message.str());
+  }
+
+  void warn(const Command command, const std::string& message) {
+    warning_num_ += 1;
+    if (warnings_.size() >= WARNING_MAX) return;
+
+    std::ostringstream str;
+    str << "frame " << frame_ << " " << info(command).name << ": " << message;
+    warnings_.push_back(str.str());
+    DOUT << "GlRecorder: " << warnings_.back() << std::endl;
+  }
+
+  void checkAttrib(const Command command, const GLuint index) {
+    if (index >= VERTEX_ATTRIB_MAX) warn(command, "invalid attribute index");
+  }
+
+  void checkUniform(const Command command) {
+    if (!program_) warn(command, "no program");
+  }
+
+  u_int clientArrayMask() const {
+    u_int mask = 0;
+    for (u_int i = 0; i < VERTEX_ATTRIB_MAX; ++i) {
+      if (client_[i].pointer) mask |= 1 << i;
+    }
+    return mask;
+  }
+
+  void checkDraw(const Command command) {
+    if (!program_) warn(command, "no program");
+  }
+
+
+  static void GL_FUNC_ENTRY enable(GLenum cap) {
+    GlRecorder& r = *current();
+    const u_int args[] = { cap };
+    if (r.call(ENABLE, args, ELEMSOF(args))) r.real_.enable(cap);
+    r.checkError(ENABLE);
+  }
+
+  static void GL_FUNC_ENTRY disable(GLenum cap) {
+    GlRecorder& r = *current();
+    const u_int args[] = { cap };
+    if (r.call(DISABLE, args, ELEMSOF(args))) r.real_.disable(cap);
+    r.checkError(DISABLE);
+  }
+
+  static void GL_FUNC_ENTRY blendFunc(GLenum sfactor, GLenum dfactor) {
+    GlRecorder& r = *current();
+    const u_int args[] = { sfactor, dfactor };
+    if (r.call(BLEND_FUNC, args, ELEMSOF(args))) r.real_.blendFunc(sfactor, dfactor);
+    r.checkError(BLEND_FUNC);
+  }
+
+  static void GL_FUNC_ENTRY blendEquation(GLenum mode) {
+    GlRecorder& r = *current();
+    const u_int args[] = { mode };
+    if (r.call(BLEND_EQUATION, args, ELEMSOF(args))) r.real_.blendEquation(mode);
+    r.checkError(BLEND_EQUATION);
+  }
+
+  static void GL_FUNC_ENTRY depthMask(GLboolean flag) {
+    GlRecorder& r = *current();
+    const u_int args[] = { flag };
+    if (r.call(DEPTH_MASK, args, ELEMSOF(args))) r.real_.depthMask(flag);
+    r.checkError(DEPTH_MASK);
+  }
+
+  static void GL_FUNC_ENTRY viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    GlRecorder& r = *current();
+    const u_int args[] = { static_cast<u_int>(x), static_cast<u_int>(y),
+                           static_cast<u_int>(width), static_cast<u_int>(height) };
+    if (r.call(VIEWPORT, args, ELEMSOF(args))) r.real_.viewport(x, y, width, height);
+    r.checkError(VIEWPORT);
+  }
+
+  static void GL_FUNC_ENTRY clear(GLbitfield mask) {
+    GlRecorder& r = *current();
+    const u_int args[] = { mask };
+    if (r.call(CLEAR, args, ELEMSOF(args))) r.real_.clear(mask);
+    r.checkError(CLEAR);
+  }
+
+  static void GL_FUNC_ENTRY lineWidth(GLfloat width) {
+    GlRecorder& r = *current();
+    const u_int args[] = { fword(width) };
+    if (r.call(LINE_WIDTH, args, ELEMSOF(args))) r.real_.lineWidth(width);
+    r.checkError(LINE_WIDTH);
+  }
+
+
+  static void GL_FUNC_ENTRY useProgram(GLuint program) {
+    GlRecorder& r = *current();
+    r.program_ = program;
+    const u_int args[] = { program };
+    r.snapshotProgram(program);
+    if (r.call(USE_PROGRAM, args, ELEMSOF(args))) r.real_.useProgram(program);
+    r.checkError(USE_PROGRAM);
+  }
+
+  static void GL_FUNC_ENTRY bindBuffer(GLenum target, GLuint buffer) {
+    GlRecorder& r = *current();
+    if (target == GL_ARRAY_BUFFER) r.array_buffer_ = buffer;
+    if (target == GL_ELEMENT_ARRAY_BUFFER) r.element_array_buffer_ = buffer;
+    const u_int args[] = { target, buffer };
+    if (r.call(BIND_BUFFER, args, ELEMSOF(args))) r.real_.bindBuffer(target, buffer);
+    r.checkError(BIND_BUFFER);
+    r.snapshotBuffer(target, buffer);
+  }
+
+  static void GL_FUNC_ENTRY bufferData(GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usage) {
+    GlRecorder& r = *current();
+    if (!r.null_ && data) r.data(data, size);
+    const u_int args[] = { target, static_cast<u_int>(size), pword(0, data), usage };
+    if (r.call(BUFFER_DATA, args, ELEMSOF(args))) r.real_.bufferData(target, size, data, usage);
+    r.checkError(BUFFER_DATA);
+  }
+
+  static void GL_FUNC_ENTRY bufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid* data) {
+    GlRecorder& r = *current();
+    if (!r.null_ && data) r.data(data, size);
+    const u_int args[] = { target, static_cast<u_int>(offset), static_cast<u_int>(size), pword(0, data) };
+    if (r.call(BUFFER_SUB_DATA, args, ELEMSOF(args))) r.real_.bufferSubData(target, offset, size, data);
+    r.checkError(BUFFER_SUB_DATA);
+  }
+
+  static void GL_FUNC_ENTRY activeTexture(GLenum texture) {
+    GlRecorder& r = *current();
+    const u_int args[] = { texture };
+    if (r.call(ACTIVE_TEXTURE, args, ELEMSOF(args))) r.real_.activeTexture(texture);
+    r.checkError(ACTIVE_TEXTURE);
+  }
+
+  static void GL_FUNC_ENTRY bindTexture(GLenum target, GLuint texture) {
+    GlRecorder& r = *current();
+    r.snapshotTexture(texture);
+    const u_int args[] = { target, texture };
+    if (r.call(BIND_TEXTURE, args, ELEMSOF(args))) r.real_.bindTexture(target, texture);
+    r.checkError(BIND_TEXTURE);
+  }
+
+  static void GL_FUNC_ENTRY bindFramebuffer(GLenum target, GLuint framebuffer) {
+    GlRecorder& r = *current();
+    const u_int args[] = { target, framebuffer };
+    if (r.call(BIND_FRAMEBUFFER, args, ELEMSOF(args))) r.real_.bindFramebuffer(target, framebuffer);
+    r.checkError(BIND_FRAMEBUFFER);
+    r.snapshotFramebuffer(framebuffer);
+  }
+
+
+  static void GL_FUNC_ENTRY enableVertexAttribArray(GLuint index) {
+    GlRecorder& r = *current();
+    r.checkAttrib(ENABLE_VERTEX_ATTRIB_ARRAY, index);
+    if (index < VERTEX_ATTRIB_MAX) r.attrib_enabled_ |= 1 << index;
+    const u_int args[] = { index };
+    if (r.call(ENABLE_VERTEX_ATTRIB_ARRAY, args, ELEMSOF(args))) r.real_.enableVertexAttribArray(index);
+    r.checkError(ENABLE_VERTEX_ATTRIB_ARRAY);
+  }
+
+  static void GL_FUNC_ENTRY disableVertexAttribArray(GLuint index) {
+    GlRecorder& r = *current();
+    r.checkAttrib(DISABLE_VERTEX_ATTRIB_ARRAY, index);
+    if (index < VERTEX_ATTRIB_MAX) r.attrib_enabled_ &= ~(1 << index);
+    const u_int args[] = { index };
+    if (r.call(DISABLE_VERTEX_ATTRIB_ARRAY, args, ELEMSOF(args))) r.real_.disableVertexAttribArray(index);
+    r.checkError(DISABLE_VERTEX_ATTRIB_ARRAY);
+  }
+
+  static void GL_FUNC_ENTRY vertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid* pointer) {
+    GlRecorder& r = *current();
+    r.checkAttrib(VERTEX_ATTRIB_POINTER, index);
+    // TIPS:ES3やCore Profileではクライアント側の頂点配列は使えない
+    if (!r.array_buffer_) r.warn(VERTEX_ATTRIB_POINTER, "client vertex array");
+    if (index < VERTEX_ATTRIB_MAX) {
+      const ClientArray array = { r.array_buffer_ ? 0 : pointer, size, type, normalized, stride };
+      r.client_[index] = array;
+    }
+    const u_int args[] = { index, static_cast<u_int>(size), type, normalized,
+                           static_cast<u_int>(stride), pword(r.array_buffer_, pointer) };
+    if (r.call(VERTEX_ATTRIB_POINTER, args, ELEMSOF(args))) r.real_.vertexAttribPointer(index, size, type, normalized, stride, pointer);
+    r.checkError(VERTEX_ATTRIB_POINTER);
+  }
+
+
+  static void GL_FUNC_ENTRY uniform1i(GLint location, GLint x) {
+    GlRecorder& r = *current();
+    r.checkUniform(UNIFORM_1I);
+    const u_int args[] = { static_cast<u_int>(location), static_cast<u_int>(x) };
+    if (r.call(UNIFORM_1I, args, ELEMSOF(args))) r.real_.uniform1i(location, x);
+    r.checkError(UNIFORM_1I);
+  }
+
+  static void GL_FUNC_ENTRY uniform1f(GLint location, GLfloat x) {
+    GlRecorder& r = *current();
+    r.checkUniform(UNIFORM_1F);
+    const u_int args[] = { static_cast<u_int>(location), fword(x) };
+    if (r.call(UNIFORM_1F, args, ELEMSOF(args))) r.real_.uniform1f(location, x);
+    r.checkError(UNIFORM_1F);
+  }
+
+  static void GL_FUNC_ENTRY uniform2f(GLint location, GLfloat x, GLfloat y) {
+    GlRecorder& r = *current();
+    r.checkUniform(UNIFORM_2F);
+    const u_int args[] = { static_cast<u_int>(location), fword(x), fword(y) };
+    if (r.call(UNIFORM_2F, args, ELEMSOF(args))) r.real_.uniform2f(location, x, y);
+    r.checkError(UNIFORM_2F);
+  }
+
+  static void GL_FUNC_ENTRY uniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z) {
+    GlRecorder& r = *current();
+    r.checkUniform(UNIFORM_3F);
+    const u_int args[] = { static_cast<u_int>(location), fword(x), fword(y), fword(z) };
+    if (r.call(UNIFORM_3F, args, ELEMSOF(args))) r.real_.uniform3f(location, x, y, z);
+    r.checkError(UNIFORM_3F);
+  }
+
+  static void GL_FUNC_ENTRY uniform4f(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
+    GlRecorder& r = *current();
+    r.checkUniform(UNIFORM_4F);
+    const u_int args[] = { static_cast<u_int>(location), fword(x), fword(y), fword(z), fword(w) };
+    if (r.call(UNIFORM_4F, args, ELEMSOF(args))) r.real_.uniform4f(location, x, y, z, w);
+    r.checkError(UNIFORM_4F);
+  }
+
+  static void GL_FUNC_ENTRY uniform3fv(GLint location, GLsizei count, const GLfloat* value) {
+    GlRecorder& r = *current();
+    r.checkUniform(UNIFORM_3FV);
+    if (!r.null_) r.data(value, count * 3 * sizeof(GLfloat));
+    const u_int args[] = { static_cast<u_int>(location), static_cast<u_int>(count), pword(0, value) };
+    if (r.call(UNIFORM_3FV, args, ELEMSOF(args))) r.real_.uniform3fv(location, count, value);
+    r.checkError(UNIFORM_3FV);
+  }
+
+  static void GL_FUNC_ENTRY uniform4fv(GLint location, GLsizei count, const GLfloat* value) {
+    GlRecorder& r = *current();
+    r.checkUniform(UNIFORM_4FV);
+    if (!r.null_) r.data(value, count * 4 * sizeof(GLfloat));
+    const u_int args[] = { static_cast<u_int>(location), static_cast<u_int>(count), pword(0, value) };
+    if (r.call(UNIFORM_4FV, args, ELEMSOF(args))) r.real_.uniform4fv(location, count, value);
+    r.checkError(UNIFORM_4FV);
+  }
+
+  static void GL_FUNC_ENTRY uniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
+    GlRecorder& r = *current();
+    r.checkUniform(UNIFORM_MATRIX_3FV);
+    if (!r.null_) r.data(value, count * 9 * sizeof(GLfloat));
+    const u_int args[] = { static_cast<u_int>(location), static_cast<u_int>(count), transpose, pword(0, value) };
+    if (r.call(UNIFORM_MATRIX_3FV, args, ELEMSOF(args))) r.real_.uniformMatrix3fv(location, count, transpose, value);
+    r.checkError(UNIFORM_MATRIX_3FV);
+  }
+
+  static void GL_FUNC_ENTRY uniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
+    GlRecorder& r = *current();
+    r.checkUniform(UNIFORM_MATRIX_4FV);
+    if (!r.null_) r.data(value, count * 16 * sizeof(GLfloat));
+    const u_int args[] = { static_cast<u_int>(location), static_cast<u_int>(count), transpose, pword(0, value) };
+    if (r.call(UNIFORM_MATRIX_4FV, args, ELEMSOF(args))) r.real_.uniformMatrix4fv(location, count, transpose, value);
+    r.checkError(UNIFORM_MATRIX_4FV);
+  }
+
+
+  static void GL_FUNC_ENTRY drawArrays(GLenum mode, GLint first, GLsizei count) {
+    GlRecorder& r = *current();
+    r.checkDraw(DRAW_ARRAYS);
+    r.captureClientArrays(first, count);
+    const u_int args[] = { mode, static_cast<u_int>(first), static_cast<u_int>(count) };
+    if (r.call(DRAW_ARRAYS, args, ELEMSOF(args))) r.real_.drawArrays(mode, first, count);
+    r.checkError(DRAW_ARRAYS);
+  }
+
+  static void GL_FUNC_ENTRY drawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices) {
+    GlRecorder& r = *current();
+    r.checkDraw(DRAW_ELEMENTS);
+    if (!r.element_array_buffer_) r.warn(DRAW_ELEMENTS, "client index array");
+    if (r.attrib_enabled_ & r.clientArrayMask()) r.warn(DRAW_ELEMENTS, "client vertex array is not captured");
+    const u_int args[] = { mode, static_cast<u_int>(count), type, pword(r.element_array_buffer_, indices) };
+    if (r.call(DRAW_ELEMENTS, args, ELEMSOF(args))) r.real_.drawElements(mode, count, type, indices);
+    r.checkError(DRAW_ELEMENTS);
+  }
+
+
+  // 記録開始時の状態を呼び出しとして残す
+  // TIPS:再生する時の初期状態になる。ドライバへは同じ値を設定し直すだけ
+  void recordState() {
+    GLint box[4];
+    glGetIntegerv(GL_VIEWPORT, box);
+    viewport(box[0], box[1], box[2], box[3]);
+
+    static const GLenum caps[] = {
+      GL_BLEND,
+      GL_DEPTH_TEST,
+      GL_CULL_FACE,
+#if defined (GL_VERTEX_PROGRAM_POINT_SIZE)
+      GL_VERTEX_PROGRAM_POINT_SIZE,
+#endif
+    };
+    for (u_int i = 0; i < ELEMSOF(caps); ++i) {
+      if (glIsEnabled(caps[i])) enable(caps[i]);
+      else                      disable(caps[i]);
+    }
+
+    GLboolean mask;
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &mask);
+    depthMask(mask);
+
+    GLint value[2];
+    glGetIntegerv(GL_BLEND_SRC_RGB, &value[0]);
+    glGetIntegerv(GL_BLEND_DST_RGB, &value[1]);
+    blendFunc(value[0], value[1]);
+    glGetIntegerv(GL_BLEND_EQUATION_RGB, &value[0]);
+    blendEquation(value[0]);
+
+    glGetIntegerv(GL_CURRENT_PROGRAM, &value[0]);
+    useProgram(value[0]);
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &value[0]);
+    bindBuffer(GL_ARRAY_BUFFER, value[0]);
+    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &value[0]);
+    bindBuffer(GL_ELEMENT_ARRAY_BUFFER, value[0]);
+
+    GLint attrib_num;
+    glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &attrib_num);
+    for (GLint i = 0; i < std::min(attrib_num, GLint(VERTEX_ATTRIB_MAX)); ++i) {
+      glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &value[0]);
+      if (value[0]) enableVertexAttribArray(i);
+    }
+  }
+
+  // 関数テーブルを記録用の関数で置き換える
+  static void hook(GlFunc& func) {
+    func.enable        = enable;
+    func.disable       = disable;
+    func.blendFunc     = blendFunc;
+    func.blendEquation = blendEquation;
+    func.depthMask     = depthMask;
+    func.viewport      = viewport;
+    func.clear         = clear;
+    func.lineWidth     = lineWidth;
+
+    func.useProgram      = useProgram;
+    func.bindBuffer      = bindBuffer;
+    func.bufferData      = bufferData;
+    func.bufferSubData   = bufferSubData;
+    func.activeTexture   = activeTexture;
+    func.bindTexture     = bindTexture;
+    func.bindFramebuffer = bindFramebuffer;
+
+    func.enableVertexAttribArray  = enableVertexAttribArray;
+    func.disableVertexAttribArray = disableVertexAttribArray;
+    func.vertexAttribPointer      = vertexAttribPointer;
+
+    func.uniform1i        = uniform1i;
+    func.uniform1f        = uniform1f;
+    func.uniform2f        = uniform2f;
+    func.uniform3f        = uniform3f;
+    func.uniform4f        = uniform4f;
+    func.uniform3fv       = uniform3fv;
+    func.uniform4fv       = uniform4fv;
+    func.uniformMatrix3fv = uniformMatrix3fv;
+    func.uniformMatrix4fv = uniformMatrix4fv;
+
+    func.drawArrays   = drawArrays;
+    func.drawElements = drawElements;
+  }
+
+
+  // 記録した内容をバイナリで書き出す
+  void writeStream(const std::string& path) const {
+    std::ofstream fstr(path, std::ios::binary);
+    if (!fstr) {
+      DOUT << "GlRecorder: can't write " << path << std::endl;
+      return;
+    }
+
+    const u_int header[] = {
+      VERSION, COMMAND_NUM, frame_, static_cast<u_int>(stream_.size())
+    };
+    fstr.write("NGSGLREC", 8);
+    fstr.write(reinterpret_cast<const char*>(header), sizeof(header));
+    if (!stream_.empty()) {
+      fstr.write(reinterpret_cast<const char*>(&stream_[0]), stream_.size() * sizeof(u_int));
+    }
+  }
+
+  // 集計と呼び出しの一覧をテキストで書き出す
+  // TIPS:ビルド間で差分が取れるように、一覧には時刻を含めない
+  void writeText(const std::string& path) const {
+    std::ofstream fstr(path);
+    if (!fstr) {
+      DOUT << "GlRecorder: can't write " << path << std::endl;
+      return;
+    }
+
+    fstr << "frames " << frame_ << (null_ ? " (null)" : "") << "\n";
+    if (!frame_time_.empty()) {
+      float total = 0.0f;
+      for (const float time : frame_time_) total += time;
+      fstr << std::fixed << std::setprecision(3)
+           << "draw ms avg " << total / frame_time_.size()
+           << " min " << *std::min_element(frame_time_.begin(), frame_time_.end())
+           << " max " << *std::max_element(frame_time_.begin(), frame_time_.end()) << "\n";
+      fstr.unsetf(std::ios::floatfield);
+      fstr << std::setprecision(6);
+    }
+
+    const u_int frames = std::max(frame_, 1u);
+    u_int calls = 0;
+    for (u_int i = 0; i < FRAME; ++i) calls += count_[i];
+    fstr << "calls " << calls << " per frame " << calls / frames << "\n\n";
+
+    for (u_int i = 0; i < FRAME; ++i) {
+      if (!count_[i]) continue;
+      fstr << std::left << std::setw(28) << info(Command(i)).name << std::right
+           << std::setw(8) << count_[i] << std::setw(8) << count_[i] / frames;
+      if (errors_[i]) fstr << " errors " << errors_[i];
+      fstr << "\n";
+    }
+
+    fstr << "\nwarnings " << warning_num_ << "\n";
+    for (const auto& warning : warnings_) fstr << warning << "\n";
+
+    fstr << "\n";
+    size_t i = 0;
+    while (i < stream_.size()) {
+      const Command command = Command(stream_[i] & 0xff);
+      const u_int num = stream_[i] >> 8;
+      const u_int* args = &stream_[i + 2];
+      i += 2 + num;
+
+      if (command == FRAME) {
+        fstr << "# frame " << args[0] << "\n";
+        continue;
+      }
+
+      if (command == DATA) {
+        // TIPS:中身はハッシュ値で比べる
+        u_int hash = 2166136261u;
+        const u_char* bytes = reinterpret_cast<const u_char*>(args + 1);
+        for (u_int j = 0; j < args[0]; ++j) {
+          hash = (hash ^ bytes[j]) * 16777619u;
+        }
+        fstr << "data(" << args[0] << ", " << std::hex << std::setw(8) << std::setfill('0') << hash
+             << std::dec << std::setfill(' ') << ")\n";
+        continue;
+      }
+
+      const Info& command_info = info(command);
+      fstr << command_info.name << "(";
+      for (u_int j = 0; j < num; ++j) {
+        if (j) fstr << ", ";
+        writeArg(fstr, command_info.signature[j], args[j]);
+      }
+      fstr << ")\n";
+    }
+  }
+
+  static void writeArg(std::ostream& fstr, const char type, const u_int value) {
+    switch (type) {
+    case 'e':
+      fstr << "0x" << std::hex << std::setw(4) << std::setfill('0') << value << std::dec << std::setfill(' ');
+      break;
+
+    case 'i':
+      fstr << static_cast<int>(value);
+      break;
+
+    case 'f':
+      {
+        float f;
+        std::memcpy(&f, &value, sizeof(f));
+        fstr << f;
+      }
+      break;
+
+    case 'p':
+      if (value == CLIENT_POINTER) fstr << "client";
+      else                         fstr << value;
+      break;
+
+    default:
+      fstr << value;
+      break;
+    }
+  }
+
+
+public:
+  GlRecorder() :
+    active_(false),
+    null_(false),
+    frames_(0),
+    frame_(0),
+    frame_start_(0.0),
+    warning_num_(0),
+    program_(0),
+    array_buffer_(0),
+    element_array_buffer_(0),
+    attrib_enabled_(0)
+  {
+    DOUT << "GlRecorder()" << std::endl;
+  }
+
+  ~GlRecorder() {
+    DOUT << "~GlRecorder()" << std::endl;
+    if (active_) stop();
+  }
+
+
+  bool active() const { return active_; }
+  bool null() const { return null_; }
+
+  // プログラムのソースを登録
+  static void source(const GLuint program, const std::string& vsh, const std::string& fsh) {
+    Source& source = sources()[program];
+    source.vsh = vsh;
+    source.fsh = fsh;
+  }
+
+  // 記録開始
+  // framesだけDRAWを記録したら、path.bin と path.txt に書き出して止まる
+  // null_backend: 描画だけに関わる呼び出しをドライバへ渡さない
+  // TIPS:OpenGLのコンテキストが準備できてから呼ぶ
+  void start(const u_int frames, const bool null_backend, const std::string& path) {
+    if (active_ || current()) return;
+
+    active_ = true;
+    null_   = null_backend;
+    frames_ = std::max(frames, 1u);
+    frame_  = 0;
+    path_   = path;
+
+    stream_.clear();
+    frame_time_.clear();
+    frame_start_ = glfwGetTime();
+    std::fill(count_, count_ + COMMAND_NUM, 0);
+    std::fill(errors_, errors_ + COMMAND_NUM, 0);
+    warning_num_ = 0;
+    warnings_.clear();
+
+    program_              = 0;
+    array_buffer_         = 0;
+    element_array_buffer_ = 0;
+    for (u_int i = 0; i < VERTEX_ATTRIB_MAX; ++i) client_[i].pointer = 0;
+    attrib_enabled_ = 0;
+    buffers_.clear();
+    textures_.clear();
+    programs_.clear();
+    framebuffers_.clear();
+
+    // 溜まっているエラーは捨てる
+    while (glGetError() != GL_NO_ERROR) {}
+
+    real_ = gl_func;
+    current() = this;
+    hook(gl_func);
+
+    recordState();
+
+    DOUT << "GlRecorder: start " << frames_ << " frames" << (null_ ? " (null)" : "") << std::endl;
+  }
+
+  void stop() {
+    if (!active_) return;
+
+    gl_func = real_;
+    current() = 0;
+    active_ = false;
+
+    writeStream(path_ + ".bin");
+    writeText(path_ + ".txt");
+    DOUT << "GlRecorder: " << frame_ << " frames, " << stream_.size() * sizeof(u_int) << " bytes, "
+         << warning_num_ << " warnings -> " << path_ << std::endl;
+  }
+
+  // DRAWの開始と終了
+  void begin() {
+    if (!active_) return;
+
+    frame_start_ = glfwGetTime();
+    const u_int args[] = { frame_ };
+    call(FRAME, args, ELEMSOF(args));
+  }
+
+  void end() {
+    if (!active_) return;
+
+    frame_time_.push_back(float((glfwGetTime() - frame_start_) * 1000.0));
+    frame_ += 1;
+    if (frame_ >= frames_) stop();
+  }
+
+};
+
+}
+
+#endif
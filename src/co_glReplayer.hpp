@@ -0,0 +1,437 @@
+﻿
+#pragma once
+
+//
+// GlRecorderで記録した呼び出しの再生
+// 記録されたオブジェクトを作り直し、呼び出しを同じ順番で発行する
+// TIPS:IDやuniform変数の位置はドライバ毎に違うので、記録時の値から変換する
+//
+
+#include "co_defines.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <unordered_map>
+#include <boost/noncopyable.hpp>
+#include "co_glCommand.hpp"
+
+
+namespace ngs {
+
+class GlReplayer : private GlCommand, private boost::noncopyable {
+  std::vector<u_int> stream_;
+  u_int frames_;
+  // 最初のフレームの位置(それより前は記録開始時の状態)
+  size_t frame_top_;
+
+  // 記録時のID→再生時のID
+  std::unordered_map<GLuint, GLuint> buffers_;
+  std::unordered_map<GLuint, GLuint> textures_;
+  std::unordered_map<GLuint, GLuint> programs_;
+  std::unordered_map<GLuint, GLuint> framebuffers_;
+  std::vector<GLuint> renderbuffers_;
+  // [記録時のプログラム][記録時の位置] → 再生時の位置
+  std::unordered_map<GLuint, std::unordered_map<GLint, GLint> > uniforms_;
+
+  GLuint program_;
+  // 直前のDATA
+  const GLvoid* data_;
+  u_int data_bytes_;
+
+
+  static GLuint find(const std::unordered_map<GLuint, GLuint>& ids, const GLuint id) {
+    const auto it = ids.find(id);
+    return (it != ids.end()) ? it->second : 0;
+  }
+
+  static float fvalue(const u_int word) {
+    float value;
+    std::memcpy(&value, &word, sizeof(value));
+    return value;
+  }
+
+  static const GLvoid* offset(const u_int word) {
+    return reinterpret_cast<const GLvoid*>(static_cast<size_t>(word));
+  }
+
+  // クライアント側のメモリを指していればDATAの中身
+  const GLvoid* pointer(const u_int word) const {
+    return (word == CLIENT_POINTER) ? data_ : offset(word);
+  }
+
+  GLint uniform(const GLint location) const {
+    const auto it = uniforms_.find(program_);
+    if (it == uniforms_.end()) return -1;
+    const auto loc = it->second.find(location);
+    return (loc != it->second.end()) ? loc->second : -1;
+  }
+
+
+  GLuint compile(const GLenum type, const char* text) const {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &text, 0);
+    glCompileShader(shader);
+
+    GLint compiled;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (compiled == GL_FALSE) {
+      GLint length;
+      glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+      std::string log(length + 1, ' ');
+      glGetShaderInfoLog(shader, length, &length, &log[0]);
+      std::cout << "compile error:" << log << std::endl;
+    }
+    return shader;
+  }
+
+  // 記録時と同じ位置にattributeを割り当ててリンクする
+  void createProgram(const GLuint id, const char* text, const size_t bytes) {
+    std::vector<std::string> entries;
+    for (const char* p = text; p < (text + bytes); p += std::strlen(p) + 1) {
+      entries.push_back(p);
+    }
+    if ((entries.size() < 2) || entries[0].empty()) {
+      std::cout << "program " << id << ": no shader source" << std::endl;
+      return;
+    }
+
+    GLuint program = glCreateProgram();
+    GLuint vertex_shader   = compile(GL_VERTEX_SHADER, entries[0].c_str());
+    GLuint fragment_shader = compile(GL_FRAGMENT_SHADER, entries[1].c_str());
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+
+    for (size_t i = 2; i < entries.size(); ++i) {
+      std::istringstream entry(entries[i]);
+      std::string kind;
+      GLint location;
+      std::string name;
+      entry >> kind >> location >> name;
+      if ((kind == "a") && (location >= 0)) glBindAttribLocation(program, location, name.c_str());
+    }
+    glLinkProgram(program);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    std::unordered_map<GLint, GLint>& uniforms = uniforms_[id];
+    for (size_t i = 2; i < entries.size(); ++i) {
+      std::istringstream entry(entries[i]);
+      std::string kind;
+      GLint location;
+      std::string name;
+      entry >> kind >> location >> name;
+      if (kind == "u") uniforms[location] = glGetUniformLocation(program, name.c_str());
+    }
+
+    programs_[id] = program;
+  }
+
+  void createBuffer(const u_int* args) {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, args[1], data_, args[2]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    buffers_[args[0]] = buffer;
+  }
+
+  void createTexture(const u_int* args) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, args[1], args[2], 0, GL_RGBA, GL_UNSIGNED_BYTE, data_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, args[3]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, args[4]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, args[5]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, args[6]);
+    if ((args[3] != GL_NEAREST) && (args[3] != GL_LINEAR)) glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    textures_[args[0]] = texture;
+  }
+
+  // TIPS:描画先のテクスチャは先に作られている
+  void createFramebuffer(const u_int* args) {
+    GLuint renderbuffer;
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, args[2], args[3]);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    renderbuffers_.push_back(renderbuffer);
+
+    GLuint framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, find(textures_, args[1]), 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    framebuffers_[args[0]] = framebuffer;
+  }
+
+  void issue(const Command command, const u_int* args) {
+    switch (command) {
+    case ENABLE:
+      glEnable(args[0]);
+      break;
+
+    case DISABLE:
+      glDisable(args[0]);
+      break;
+
+    case BLEND_FUNC:
+      glBlendFunc(args[0], args[1]);
+      break;
+
+    case BLEND_EQUATION:
+      glBlendEquation(args[0]);
+      break;
+
+    case DEPTH_MASK:
+      glDepthMask(args[0]);
+      break;
+
+    case VIEWPORT:
+      glViewport(args[0], args[1], args[2], args[3]);
+      break;
+
+    case CLEAR:
+      glClear(args[0]);
+      break;
+
+    case LINE_WIDTH:
+      glLineWidth(fvalue(args[0]));
+      break;
+
+    case USE_PROGRAM:
+      program_ = args[0];
+      glUseProgram(find(programs_, args[0]));
+      break;
+
+    case BIND_BUFFER:
+      glBindBuffer(args[0], find(buffers_, args[1]));
+      break;
+
+    case BUFFER_DATA:
+      glBufferData(args[0], args[1], pointer(args[2]), args[3]);
+      break;
+
+    case BUFFER_SUB_DATA:
+      glBufferSubData(args[0], args[1], args[2], pointer(args[3]));
+      break;
+
+    case ACTIVE_TEXTURE:
+      glActiveTexture(args[0]);
+      break;
+
+    case BIND_TEXTURE:
+      glBindTexture(args[0], find(textures_, args[1]));
+      break;
+
+    case BIND_FRAMEBUFFER:
+      glBindFramebuffer(args[0], find(framebuffers_, args[1]));
+      break;
+
+    case ENABLE_VERTEX_ATTRIB_ARRAY:
+      glEnableVertexAttribArray(args[0]);
+      break;
+
+    case DISABLE_VERTEX_ATTRIB_ARRAY:
+      glDisableVertexAttribArray(args[0]);
+      break;
+
+    case VERTEX_ATTRIB_POINTER:
+      // TIPS:クライアント側の配列は描画直前のCLIENT_ARRAYで設定する
+      if (args[5] == CLIENT_POINTER) break;
+      glVertexAttribPointer(args[0], args[1], args[2], args[3], args[4], offset(args[5]));
+      break;
+
+    case CLIENT_ARRAY:
+      glVertexAttribPointer(args[0], args[1], args[2], args[3], args[4], data_);
+      break;
+
+    case UNIFORM_1I:
+      glUniform1i(uniform(args[0]), args[1]);
+      break;
+
+    case UNIFORM_1F:
+      glUniform1f(uniform(args[0]), fvalue(args[1]));
+      break;
+
+    case UNIFORM_2F:
+      glUniform2f(uniform(args[0]), fvalue(args[1]), fvalue(args[2]));
+      break;
+
+    case UNIFORM_3F:
+      glUniform3f(uniform(args[0]), fvalue(args[1]), fvalue(args[2]), fvalue(args[3]));
+      break;
+
+    case UNIFORM_4F:
+      glUniform4f(uniform(args[0]), fvalue(args[1]), fvalue(args[2]), fvalue(args[3]), fvalue(args[4]));
+      break;
+
+    case UNIFORM_3FV:
+      glUniform3fv(uniform(args[0]), args[1], static_cast<const GLfloat*>(data_));
+      break;
+
+    case UNIFORM_4FV:
+      glUniform4fv(uniform(args[0]), args[1], static_cast<const GLfloat*>(data_));
+      break;
+
+    case UNIFORM_MATRIX_3FV:
+      glUniformMatrix3fv(uniform(args[0]), args[1], args[2], static_cast<const GLfloat*>(data_));
+      break;
+
+    case UNIFORM_MATRIX_4FV:
+      glUniformMatrix4fv(uniform(args[0]), args[1], args[2], static_cast<const GLfloat*>(data_));
+      break;
+
+    case DRAW_ARRAYS:
+      glDrawArrays(args[0], args[1], args[2]);
+      break;
+
+    case DRAW_ELEMENTS:
+      // TIPS:クライアント側のインデックスは記録していない
+      if (args[3] == CLIENT_POINTER) break;
+      glDrawElements(args[0], args[1], args[2], offset(args[3]));
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  // 範囲内の呼び出しを発行する
+  void play(const size_t top, const size_t bottom) {
+    size_t i = top;
+    while (i < bottom) {
+      const Command command = Command(stream_[i] & 0xff);
+      const u_int num = stream_[i] >> 8;
+      const u_int* args = &stream_[i + 2];
+      i += 2 + num;
+
+      if (command == DATA) data_ = args + 1;
+      else                 issue(command, args);
+    }
+  }
+
+
+public:
+  GlReplayer() :
+    frames_(0),
+    frame_top_(0),
+    program_(0),
+    data_(0),
+    data_bytes_(0)
+  {}
+
+  ~GlReplayer() {
+    for (const auto& id : programs_) glDeleteProgram(id.second);
+    for (const auto& id : buffers_) glDeleteBuffers(1, &id.second);
+    for (const auto& id : textures_) glDeleteTextures(1, &id.second);
+    for (const auto& id : framebuffers_) glDeleteFramebuffers(1, &id.second);
+    if (!renderbuffers_.empty()) {
+      glDeleteRenderbuffers(GLsizei(renderbuffers_.size()), &renderbuffers_[0]);
+    }
+  }
+
+
+  // 読み込み
+  // false: 形式が違う
+  bool read(const std::string& path) {
+    std::ifstream fstr(path, std::ios::binary);
+    if (!fstr) return false;
+
+    char id[8];
+    u_int header[4];
+    fstr.read(id, sizeof(id));
+    fstr.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!fstr || std::memcmp(id, "NGSGLREC", sizeof(id)) || (header[0] != VERSION) || (header[1] != COMMAND_NUM)) {
+      return false;
+    }
+
+    frames_ = header[2];
+    stream_.resize(header[3]);
+    if (!stream_.empty()) {
+      fstr.read(reinterpret_cast<char*>(&stream_[0]), stream_.size() * sizeof(u_int));
+    }
+    if (!fstr) return false;
+
+    // 最初のフレームの位置を探す
+    frame_top_ = stream_.size();
+    size_t i = 0;
+    while (i < stream_.size()) {
+      if ((stream_[i] & 0xff) == FRAME) {
+        frame_top_ = i;
+        break;
+      }
+      i += 2 + (stream_[i] >> 8);
+    }
+    return true;
+  }
+
+  u_int frames() const { return frames_; }
+
+  // 記録開始時の画面の大きさ
+  bool viewport(GLint* box) const {
+    size_t i = 0;
+    while (i < frame_top_) {
+      if ((stream_[i] & 0xff) == VIEWPORT) {
+        for (u_int j = 0; j < 4; ++j) box[j] = stream_[i + 2 + j];
+        return true;
+      }
+      i += 2 + (stream_[i] >> 8);
+    }
+    return false;
+  }
+
+  // 記録されたオブジェクトを作り、記録開始時の状態にする
+  // TIPS:OpenGLのコンテキストが準備できてから呼ぶ
+  void setup() {
+    size_t i = 0;
+    while (i < stream_.size()) {
+      const Command command = Command(stream_[i] & 0xff);
+      const u_int num = stream_[i] >> 8;
+      const u_int* args = &stream_[i + 2];
+      i += 2 + num;
+
+      switch (command) {
+      case DATA:
+        data_       = args + 1;
+        data_bytes_ = args[0];
+        break;
+
+      case BUFFER_OBJECT:
+        createBuffer(args);
+        break;
+
+      case TEXTURE_OBJECT:
+        createTexture(args);
+        break;
+
+      case PROGRAM_OBJECT:
+        createProgram(args[0], static_cast<const char*>(data_), data_bytes_);
+        break;
+
+      case FRAMEBUFFER_OBJECT:
+        createFramebuffer(args);
+        break;
+
+      default:
+        break;
+      }
+    }
+
+    play(0, frame_top_);
+  }
+
+  // 記録した全フレームを1回発行する
+  void replay() {
+    play(frame_top_, stream_.size());
+  }
+
+};
+
+}
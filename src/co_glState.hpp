@@ -3,54 +3,213 @@
 
 //
 // OpenGLの状態を監視
+// 前回と同じ値の設定は発行しない
+// TIPS:生成や破棄も含めて、対象の状態の変更は全てここを通すこと
 //
 
 #include "co_defines.hpp"
+#include <cassert>
 
 
 namespace {
 
 class GlState {
-  bool blend_;
-  bool depth_test_;
-  bool cull_face_;
+public:
+  enum {
+    TEXTURE_UNIT_MAX = 8
+  };
+
+  // 1フレームあたりの発行数と、省いた数
+  struct Counter {
+    u_int issued;
+    u_int filtered;
+  };
+
+  
+private:
+  // 値と、それがOpenGL側と一致しているか
+  template <typename T>
+  class Cache {
+    T value_;
+    bool valid_;
+
+  public:
+    Cache() :
+      value_(),
+      valid_(false)
+    {}
+
+    // 変化があれば記録してtrue
+    bool change(const T& value) {
+      if (valid_ && (value == value_)) return false;
+      value_ = value;
+      valid_ = true;
+      return true;
+    }
+
+    bool is(const T& value) const { return valid_ && (value == value_); }
+    void invalidate() { valid_ = false; }
+  };
+
+  struct BlendFunc {
+    GLenum src;
+    GLenum dst;
+
+    bool operator==(const BlendFunc& rhs) const { return (src == rhs.src) && (dst == rhs.dst); }
+  };
+
+  struct Viewport {
+    GLint x, y;
+    GLsizei width, height;
+
+    bool operator==(const Viewport& rhs) const {
+      return (x == rhs.x) && (y == rhs.y) && (width == rhs.width) && (height == rhs.height);
+    }
+  };
+  
+  Cache<bool> blend_;
+  Cache<bool> depth_test_;
+  Cache<bool> cull_face_;
+  Cache<bool> depth_mask_;
+  Cache<BlendFunc> blend_func_;
+  Cache<GLenum> blend_equation_;
+  Cache<Viewport> viewport_;
+
+  Cache<GLuint> program_;
+  Cache<GLuint> array_buffer_;
+  Cache<GLuint> element_array_buffer_;
+  Cache<u_int> active_texture_;
+  Cache<GLuint> texture_[TEXTURE_UNIT_MAX];
+  u_int texture_unit_;
 
+  Counter counter_;
+  Counter last_counter_;
+
+
+  // 変化がなければ数えて省く
+  template <typename T>
+  bool filter(Cache<T>& cache, const T& value) {
+    if (cache.change(value)) {
+      counter_.issued += 1;
+      return true;
+    }
+    counter_.filtered += 1;
+    return false;
+  }
 
+  void enable(Cache<bool>& cache, const GLenum cap, const bool flag) {
+    if (!filter(cache, flag)) return;
+    
+    if (flag) glEnable(cap);
+    else      glDisable(cap);
+  }
+  
+  
 public:
   GlState() :
-    blend_(false),
-    depth_test_(false),
-    cull_face_(false)
-  {}
+    texture_unit_(0)
+  {
+    counter_.issued = counter_.filtered = 0;
+    last_counter_ = counter_;
+  }
 
 
-  void blend(const bool flag) {
-    if (flag != blend_) {
-      if (flag) glEnable(GL_BLEND);
-      else      glDisable(GL_BLEND);
+  // フレームの区切り
+  // TIPS:環境側(GLKitなど)がフレームの間に状態を変える事があるので、記録を一旦捨てる
+  void frame() {
+    last_counter_ = counter_;
+    counter_.issued = counter_.filtered = 0;
 
-      blend_ = flag;
-    }
+    blend_.invalidate();
+    depth_test_.invalidate();
+    cull_face_.invalidate();
+    depth_mask_.invalidate();
+    blend_func_.invalidate();
+    blend_equation_.invalidate();
+    viewport_.invalidate();
+    program_.invalidate();
+    array_buffer_.invalidate();
+    element_array_buffer_.invalidate();
+    active_texture_.invalidate();
+    for (auto& texture : texture_) texture.invalidate();
   }
+
+  // 直前のフレームの発行数
+  const Counter& counter() const { return last_counter_; }
+
   
-  void depthTest(const bool flag) {
-    if (flag != depth_test_) {
-      if (flag) glEnable(GL_DEPTH_TEST);
-      else      glDisable(GL_DEPTH_TEST);
+  void blend(const bool flag) { enable(blend_, GL_BLEND, flag); }
+  void depthTest(const bool flag) { enable(depth_test_, GL_DEPTH_TEST, flag); }
+  void cullFace(const bool flag) { enable(cull_face_, GL_CULL_FACE, flag); }
 
-      depth_test_ = flag;
-    }
+  void depthMask(const bool flag) {
+    if (filter(depth_mask_, flag)) glDepthMask(flag ? GL_TRUE : GL_FALSE);
+  }
+  
+  void blendFunc(const GLenum src, const GLenum dst) {
+    const BlendFunc func = { src, dst };
+    if (filter(blend_func_, func)) glBlendFunc(src, dst);
+  }
+
+  void blendEquation(const GLenum mode) {
+    if (filter(blend_equation_, mode)) glBlendEquation(mode);
+  }
+
+  void viewport(const GLint x, const GLint y, const GLsizei width, const GLsizei height) {
+    const Viewport viewport = { x, y, width, height };
+    if (filter(viewport_, viewport)) glViewport(x, y, width, height);
+  }
+
+  
+  void program(const GLuint id) {
+    if (filter(program_, id)) glUseProgram(id);
   }
+
+  // GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER
+  void buffer(const GLenum target, const GLuint id) {
+    Cache<GLuint>& cache = (target == GL_ARRAY_BUFFER) ? array_buffer_ : element_array_buffer_;
+    if (filter(cache, id)) glBindBuffer(target, id);
+  }
+
+  void arrayBuffer(const GLuint id) { buffer(GL_ARRAY_BUFFER, id); }
+  void elementArrayBuffer(const GLuint id) { buffer(GL_ELEMENT_ARRAY_BUFFER, id); }
+
+  void activeTexture(const u_int unit) {
+    assert(unit < TEXTURE_UNIT_MAX);
+    texture_unit_ = unit;
+    if (filter(active_texture_, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+  }
+  
+  // 現在のテクスチャユニットにバインド
+  void texture(const GLuint id) {
+    if (filter(texture_[texture_unit_], id)) glBindTexture(GL_TEXTURE_2D, id);
+  }
+
   
-  void cullFace(const bool flag) {
-    if (flag != cull_face_) {
-      if (flag) glEnable(GL_CULL_FACE);
-      else      glDisable(GL_CULL_FACE);
+  // 破棄
+  // TIPS:バインド中のものを破棄すると0がバインドされた状態になる
+  void deleteProgram(const GLuint id) {
+    glDeleteProgram(id);
+    // TIPS:使用中のプログラムは破棄が遅れるので、記録だけ捨てる
+    if (program_.is(id)) program_.invalidate();
+  }
 
-      cull_face_ = flag;
+  void deleteBuffer(const GLuint id) {
+    glDeleteBuffers(1, &id);
+    if (array_buffer_.is(id)) array_buffer_.change(0);
+    if (element_array_buffer_.is(id)) element_array_buffer_.change(0);
+  }
+
+  void deleteTexture(const GLuint id) {
+    glDeleteTextures(1, &id);
+    for (auto& texture : texture_) {
+      if (texture.is(id)) texture.change(0);
     }
   }
   
 };
 
+// TIPS:OpenGLのコンテキストは1つなので、どこからでも使えるようにしておく
+GlState gl_state;
+
 }
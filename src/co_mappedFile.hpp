@@ -0,0 +1,87 @@
+﻿
+#pragma once
+
+//
+// ファイルをメモリに割り当てて読む
+//
+
+#include "co_defines.hpp"
+#include <string>
+#include <boost/noncopyable.hpp>
+
+#if defined (_MSC_VER)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+namespace ngs {
+
+class MappedFile : private boost::noncopyable {
+	const u_char* data_;
+	size_t size_;
+#if defined (_MSC_VER)
+	HANDLE file_;
+	HANDLE mapping_;
+#endif
+
+public:
+	explicit MappedFile(const std::string& path) :
+		data_(),
+		size_()
+#if defined (_MSC_VER)
+		, file_(INVALID_HANDLE_VALUE),
+		mapping_()
+#endif
+	{
+		DOUT << "MappedFile()" << std::endl;
+
+#if defined (_MSC_VER)
+		file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+		if (file_ == INVALID_HANDLE_VALUE) return;
+
+		size_ = GetFileSize(file_, 0);
+		mapping_ = CreateFileMappingA(file_, 0, PAGE_READONLY, 0, 0, 0);
+		if (!mapping_) return;
+
+		data_ = static_cast<const u_char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) return;
+
+		struct stat st;
+		if (fstat(fd, &st) == 0) {
+			void* data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data != MAP_FAILED) {
+				data_ = static_cast<const u_char*>(data);
+				size_ = st.st_size;
+			}
+		}
+		// TIPS:割り当てた後はファイルを閉じてもよい
+		close(fd);
+#endif
+	}
+
+	~MappedFile() {
+		DOUT << "~MappedFile()" << std::endl;
+
+#if defined (_MSC_VER)
+		if (data_) UnmapViewOfFile(data_);
+		if (mapping_) CloseHandle(mapping_);
+		if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+#else
+		if (data_) munmap(const_cast<u_char*>(data_), size_);
+#endif
+	}
+
+	
+	bool valid() const { return data_ != 0; }
+	const u_char* data() const { return data_; }
+	size_t size() const { return size_; }
+};
+
+}
@@ -143,10 +143,17 @@ public:
     texture_ = texture;
   }
 
-  void bindTexture() const {
-    texture_->bind();
+  // バインドしたテクスチャを返す
+  const Texture& bindTexture() const {
+    return bindTexture(*texture_);
+  }
+
+  // テクスチャを差し替えて使う
+  const Texture& bindTexture(const Texture& texture) const {
+    texture.bind();
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_u_ ? GL_REPEAT : GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_v_ ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+    return texture;
   }
 
   bool textureWrapU() const { return wrap_u_; }
@@ -156,4 +163,50 @@ public:
   
 };
 
+
+// インスタンスごとのマテリアルの上書き
+// 共有しているMaterialは書き換えず、描画時に色を合成する
+struct MaterialOverride {
+  // 拡散光:(置き換え or 元の色) * rate + add
+  Vec3f diffuse;
+  Vec3f diffuse_add;
+  float diffuse_rate;
+  bool  replace_diffuse;
+  bool  replace_specular;
+  // 自己発光:元の色 * rate + add
+  float emissive_rate;
+  Vec3f emissive_add;
+  Vec3f specular;
+  // テクスチャの差し替え(空なら元のテクスチャ)
+  TexMng::TexPtr texture;
+
+  MaterialOverride() :
+    diffuse(Vec3f::Zero()),
+    diffuse_add(Vec3f::Zero()),
+    diffuse_rate(1.0f),
+    replace_diffuse(false),
+    replace_specular(false),
+    emissive_rate(1.0f),
+    emissive_add(Vec3f::Zero()),
+    specular(Vec3f::Zero())
+  {}
+
+  Vec3f diffuseColor(const Material& material) const {
+    return (replace_diffuse ? diffuse : material.diffuse()) * diffuse_rate + diffuse_add;
+  }
+
+  Vec3f emissiveColor(const Material& material) const {
+    return material.emissive() * emissive_rate + emissive_add;
+  }
+
+  const Vec3f& specularColor(const Material& material) const {
+    return replace_specular ? specular : material.specular();
+  }
+
+  const Texture& bindTexture(const Material& material) const {
+    if (texture) return material.bindTexture(*texture);
+    else         return material.bindTexture();
+  }
+};
+
 }
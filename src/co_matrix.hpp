@@ -6,8 +6,8 @@
 //
 
 #include "co_defines.hpp"
-#include <deque>
 #include <cassert>
+#include <iostream>
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 #include "co_vector.hpp"
@@ -27,10 +27,55 @@ public:
 		MODELVIEW,
 	};
 
+	// スタックの最大の深さ
+	enum { STACK_DEPTH = 16 };
+
 private:
-	std::deque<Mat4f> projection_stack_;
-	std::deque<Mat4f> model_stack_;
-	std::deque<Mat4f>* current_;
+	// 固定長のスタック(pushでメモリ確保が発生しない)
+	// TIPS:Release版でも範囲外には書き込まない
+	//      上限を超えたpushは一番上を使い回し、その数だけpopを読み捨てる
+	struct Stack {
+		Mat4f matrix[STACK_DEPTH];
+		u_int depth;
+		u_int overflow;
+
+		Stack() :
+			depth(0),
+			overflow(0)
+		{
+			matrix[0] = Mat4f::Identity();
+		}
+
+		Mat4f& top() { return matrix[depth]; }
+
+		void push() {
+			assert((depth + 1) < STACK_DEPTH);
+			if ((depth + 1) >= STACK_DEPTH) {
+				DOUT << "Matrix stack overflow" << std::endl;
+				++overflow;
+				return;
+			}
+			matrix[depth + 1] = matrix[depth];
+			++depth;
+		}
+
+		void pop() {
+			assert((depth > 0) || overflow);
+			if (overflow) {
+				--overflow;
+				return;
+			}
+			if (depth == 0) {
+				DOUT << "Matrix stack underflow" << std::endl;
+				return;
+			}
+			--depth;
+		}
+	};
+	
+	Stack projection_stack_;
+	Stack model_stack_;
+	Stack* current_;
 
 	Mode mode_;
 	
@@ -38,10 +83,7 @@ public:
 	Matrix() :
 		current_(&projection_stack_),
 		mode_(PROJECTION)
-	{
-		projection_stack_.push_back(Mat4f::Identity());
-		model_stack_.push_back(Mat4f::Identity());
-	}
+	{}
 
 	void mode(const Mode mode) {
 		mode_ = mode;
@@ -60,12 +102,12 @@ public:
 		}
 	}
 
-	Mat4f& current() { return current_->back(); }
-	Mat4f& projection() { return projection_stack_.back(); }
-	Mat4f& model() { return model_stack_.back(); }
+	Mat4f& current() { return current_->top(); }
+	Mat4f& projection() { return projection_stack_.top(); }
+	Mat4f& model() { return model_stack_.top(); }
 
-	void push() { current_->push_back(current()); }
-	void pop() { current_->pop_back(); }
+	void push() { current_->push(); }
+	void pop() { current_->pop(); }
 };
 
 Matrix matrix_stack;
@@ -7,10 +7,18 @@
 // FIXME:OpenGL依存
 //
 
+#include <string>
 #include <vector>
 #include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <memory>
 #include <boost/noncopyable.hpp>
 #include <assimp/scene.h>
+#include "co_vector.hpp"
+#include "co_meshOptimizer.hpp"
+#include "co_meshBuffer.hpp"
+#include "co_meshSimplifier.hpp"
 
 
 namespace ngs {
@@ -35,29 +43,107 @@ public:
 		Vtx normal;
 		Uv uv;
 	};
-	struct Face {
-		GLushort v1, v2, v3;
-	};
+
+  // 量子化した頂点(16バイト)
+  // 位置:AABBで[-1, 1]に正規化したshort 法線:正規化したbyte UV:[0, 1]を正規化したushort
+  struct PackedBody {
+    GLshort  x, y, z, w;
+    GLbyte   nx, ny, nz, nw;
+    GLushort u, v;
+  };
+
+  // glVertexAttribPointerに渡す値
+  struct Attrib {
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    const GLvoid* offset;
+  };
+
+  // 量子化で許容する誤差
+  // 位置はAABBの対角線に対する比率、法線は角度(度)
+  static float positionTolerance() { return 1.0e-4f; }
+  static float normalTolerance() { return 1.0f; }
+
+  // LODの段階数(0が元のメッシュ)
+  enum { LOD_NUM = 3 };
+
+  // LODごとの目標の面数の比率と、許容する誤差(AABBの対角線に対する比率)
+  static float lodRatio(const u_int level) {
+    static const float ratio[] = { 1.0f, 0.5f, 0.25f };
+    return ratio[level];
+  }
+  static float lodError(const u_int level) {
+    static const float error[] = { 0.0f, 0.01f, 0.03f };
+    return error[level];
+  }
+
+  // LODごとの描画範囲
+  struct Lod {
+    GLsizei points;
+    size_t index_offset;
+  };
 
 private:
-	GLuint vbo_[NUM_VBO];
+  // 32bitのインデックスが使えるか
+  // TIPS:ES 2.0ではGL_OES_element_index_uintが必要
+  static bool uintIndexAvailable() {
+#if (TARGET_OS_IPHONE)
+    static const bool available = [] {
+      const GLubyte* extensions = glGetString(GL_EXTENSIONS);
+      if (!extensions) return false;
+      const std::string names = " " + std::string(reinterpret_cast<const char*>(extensions)) + " ";
+      return names.find(" GL_OES_element_index_uint ") != std::string::npos;
+    }();
+    return available;
+#else
+    return true;
+#endif
+  }
+
+  // 頂点とインデックスは共有バッファに置く
+  std::shared_ptr<MeshBuffer> buffer_;
+  MeshBuffer::Range range_;
+  // 量子化しているか
+  bool packed_;
+  // 量子化した位置を元に戻す行列
+  Mat4f position_matrix_;
+  size_t bytes_;
 
   bool has_normal_;
   bool has_texture_;
   u_int faces_;
 	GLuint points_;
+  u_int vertices_;
   u_int material_index_;
+  // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+  GLenum index_type_;
+  // 面の並べ替え前後のACMR
+  float acmr_before_;
+  float acmr_after_;
+  // 簡略化したメッシュはインデックスだけ持つ
+  std::vector<Lod> lods_;
 
   Vec3f min_pos_;
   Vec3f max_pos_;
   
 public:
-  explicit Mesh(const aiMesh& mesh) :
+  // buffer: 複数のメッシュで頂点バッファを共有する場合に指定
+  explicit Mesh(const aiMesh& mesh,
+                const std::shared_ptr<MeshBuffer>& buffer = std::make_shared<MeshBuffer>()) :
+    buffer_(buffer),
+    packed_(false),
+    position_matrix_(Mat4f::Identity()),
+    bytes_(0),
     has_normal_(mesh.HasNormals()),
     has_texture_(mesh.HasTextureCoords(0)),
     faces_(mesh.mNumFaces),
     points_(mesh.mNumFaces * 3),
+    vertices_(mesh.mNumVertices),
     material_index_(mesh.mMaterialIndex),
+    index_type_(GL_UNSIGNED_SHORT),
+    acmr_before_(0.0f),
+    acmr_after_(0.0f),
     min_pos_(FLT_MAX, FLT_MAX, FLT_MAX),
     max_pos_(-FLT_MAX, -FLT_MAX, -FLT_MAX)
   {
@@ -110,48 +196,251 @@ public:
 
     // 面情報を生成
     aiFace* f = mesh.mFaces;
-    std::vector<Face> face;
-    face.reserve(mesh.mNumFaces);
+    std::vector<u_int> indices;
+    indices.reserve(mesh.mNumFaces * 3);
 
     for (u_int i = 0; i < mesh.mNumFaces; ++i) {
       // 三角ポリゴン以外はエラー
       assert(f->mNumIndices == 3);
 
-      Face obj;
-      obj.v1 = f->mIndices[0];
-      obj.v2 = f->mIndices[1];
-      obj.v3 = f->mIndices[2];
-      face.push_back(obj);
+      indices.push_back(f->mIndices[0]);
+      indices.push_back(f->mIndices[1]);
+      indices.push_back(f->mIndices[2]);
 
       ++f;
     }
 
-    // OpenGLのFrame Buffer Objectを生成して、頂点データを転送する
-		glGenBuffers(NUM_VBO, vbo_);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo_[ARRAY]);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(Body) * body.size(), &body[0], GL_STATIC_DRAW);
-		
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo_[ELEMENT_ARRAY]);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Face) * face.size(), &face[0], GL_STATIC_DRAW);
-
-    // バッファの紐づけを解除
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    // 簡略化したLODを生成
+    // TIPS:頂点は元のメッシュと共有するので、インデックスだけが増える
+    std::vector<std::vector<u_int> > levels(1, indices);
+    {
+      std::vector<Vec3f> positions;
+      positions.reserve(body.size());
+      for (const auto& b : body) {
+        positions.push_back(Vec3f(b.vertex.x, b.vertex.y, b.vertex.z));
+      }
+
+      for (u_int level = 1; level < LOD_NUM; ++level) {
+        const size_t target = static_cast<size_t>(indices.size() * lodRatio(level)) / 3 * 3;
+        std::vector<u_int> simplified = MeshSimplifier::simplify(positions, levels.back(), target, lodError(level));
+        // 1割も減らないなら打ち切る
+        if ((simplified.size() * 10) > (levels.back().size() * 9)) break;
+
+        levels.push_back(simplified);
+      }
+    }
+
+    // 頂点キャッシュが効くように面を並べ替え、頂点も使う順に並べ直す
+    acmr_before_ = MeshOptimizer::acmr(levels[0]);
+    for (auto& level : levels) {
+      MeshOptimizer::optimizeFaces(level, mesh.mNumVertices);
+    }
+    acmr_after_ = MeshOptimizer::acmr(levels[0]);
+    {
+      const std::vector<u_int> remap = MeshOptimizer::optimizeVertices(levels[0], mesh.mNumVertices);
+      std::vector<Body> sorted(body.size());
+      for (u_int i = 0; i < body.size(); ++i) {
+        sorted[remap[i]] = body[i];
+      }
+      body.swap(sorted);
+
+      for (u_int i = 1; i < levels.size(); ++i) {
+        for (auto& index : levels[i]) index = remap[index];
+      }
+    }
+    DOUT << "Mesh ACMR:" << acmr_before_ << "->" << acmr_after_ << std::endl;
+
+    // 全てのLODのインデックスを1つにまとめる
+    indices.clear();
+    for (const auto& level : levels) {
+      Lod lod = { static_cast<GLsizei>(level.size()), indices.size() };
+      lods_.push_back(lod);
+      indices.insert(indices.end(), level.begin(), level.end());
+#ifdef _DEBUG
+      DOUT << "Mesh LOD" << lods_.size() - 1 << ":" << level.size() / 3 << " faces" << std::endl;
+#endif
+    }
+
+    // 誤差が許容範囲なら量子化した頂点を使う
+    std::vector<PackedBody> packed_body;
+    packed_ = pack(packed_body, body);
+    bytes_  = packed_ ? (sizeof(PackedBody) * packed_body.size()) : (sizeof(Body) * body.size());
+    
+    // 共有バッファへ頂点データを転送する
+    // TIPS:内容が同じメッシュは同じ領域を使う
+    const void* vertex_data = packed_ ? static_cast<const void*>(packed_body.data()) : static_cast<const void*>(body.data());
+    if (mesh.mNumVertices > 0x10000) {
+      // TIPS:16bitで足りない時だけ32bitにする
+      if (!uintIndexAvailable()) {
+        // 描画しても何も出ないので、空のメッシュとして扱う
+        DOUT << "Mesh error: " << mesh.mNumVertices << " vertices need GL_OES_element_index_uint" << std::endl;
+        for (auto& lod : lods_) lod.points = 0;
+        points_ = 0;
+        range_.vertex_offset = 0;
+        range_.index_offset  = 0;
+        return;
+      }
+      index_type_ = GL_UNSIGNED_INT;
+      for (auto& lod : lods_) lod.index_offset *= sizeof(GLuint);
+      range_ = buffer_->add(vertex_data, bytes_, indices.data(), sizeof(GLuint) * indices.size());
+    }
+    else {
+      for (auto& lod : lods_) lod.index_offset *= sizeof(GLushort);
+      std::vector<GLushort> short_indices(indices.begin(), indices.end());
+      range_ = buffer_->add(vertex_data, bytes_, short_indices.data(), sizeof(GLushort) * short_indices.size());
+    }
   }
 
   ~Mesh() {
     DOUT << "~Mesh()" << std::endl;
-		glDeleteBuffers(NUM_VBO, vbo_);
   }
 
   u_int materialIndex() const { return material_index_; }
 
-	GLuint vbo(const Buffer index) const { return vbo_[index]; }
+	GLuint vbo(const Buffer index) const { return (index == ARRAY) ? buffer_->vertexVbo() : buffer_->indexVbo(); }
+  // glDrawElementsに渡すインデックスの位置
+  const GLvoid* indexOffset(const u_int lod = 0) const {
+    return reinterpret_cast<const GLvoid*>(range_.index_offset + lods_[lod].index_offset);
+  }
+  // LODごとのインデックス数
+  GLsizei points(const u_int lod) const { return lods_[lod].points; }
+  // 持っているLODの数
+  u_int lods() const { return static_cast<u_int>(lods_.size()); }
 	GLuint points() const { return points_; }
   u_int faces() const { return faces_; }
+  GLenum indexType() const { return index_type_; }
+
+  float acmrBefore() const { return acmr_before_; }
+  float acmrAfter() const { return acmr_after_; }
 
   const Vec3f& minPos() const { return min_pos_; }
   const Vec3f& maxPos() const { return max_pos_; }
+
+  bool packed() const { return packed_; }
+  // 頂点バッファのバイト数
+  size_t bytes() const { return bytes_; }
+  // 量子化していない場合のバイト数
+  size_t floatBytes() const { return sizeof(Body) * vertices_; }
+
+  // 位置を元の座標系に戻す行列
+  // TIPS:modelViewMatrixに掛けておけばシェーダー側での変換は要らない
+  const Mat4f& positionMatrix() const { return position_matrix_; }
+
+  GLsizei stride() const { return packed_ ? sizeof(PackedBody) : sizeof(Body); }
+
+  Attrib position() const {
+    Attrib attrib = { 3, GL_FLOAT, GL_FALSE, vertexOffset(0) };
+    if (packed_) {
+      attrib.type       = GL_SHORT;
+      attrib.normalized = GL_TRUE;
+    }
+    return attrib;
+  }
+
+  Attrib normal() const {
+    Attrib attrib = { 3, GL_FLOAT, GL_FALSE, vertexOffset(offsetof(Body, normal)) };
+    if (packed_) {
+      attrib.type       = GL_BYTE;
+      attrib.normalized = GL_TRUE;
+      attrib.offset     = vertexOffset(offsetof(PackedBody, nx));
+    }
+    return attrib;
+  }
+
+  Attrib uv() const {
+    Attrib attrib = { 2, GL_FLOAT, GL_FALSE, vertexOffset(offsetof(Body, uv)) };
+    if (packed_) {
+      attrib.type       = GL_UNSIGNED_SHORT;
+      attrib.normalized = GL_TRUE;
+      attrib.offset     = vertexOffset(offsetof(PackedBody, u));
+    }
+    return attrib;
+  }
+
+
+private:
+  // 共有バッファ内での頂点属性の位置
+  const GLvoid* vertexOffset(const size_t offset) const {
+    return reinterpret_cast<const GLvoid*>(range_.vertex_offset + offset);
+  }
+  
+  // [-1, 1]を符号付き整数へ
+  // TIPS:ES 2.0では (2c + 1) / (2^b - 1) で浮動小数点に戻される
+  static int toSigned(const float value, const int bits) {
+    const int max_value = (1 << (bits - 1)) - 1;
+    int c = static_cast<int>(std::floor((value * ((1 << bits) - 1) - 1.0f) * 0.5f + 0.5f));
+    return std::max(-max_value - 1, std::min(c, max_value));
+  }
+
+  static float fromSigned(const int value, const int bits) {
+    return (2.0f * value + 1.0f) / ((1 << bits) - 1);
+  }
+
+  // 量子化する
+  // false: 誤差が大きいので使えない
+  bool pack(std::vector<PackedBody>& packed_body, const std::vector<Body>& body) {
+    if (body.empty()) return false;
+    
+    // TIPS:UVが[0, 1]を超える(繰り返す)場合は量子化しない
+    if (has_texture_) {
+      for (const auto& b : body) {
+        if ((b.uv.u < 0.0f) || (b.uv.u > 1.0f) || (b.uv.v < 0.0f) || (b.uv.v > 1.0f)) return false;
+      }
+    }
+
+    const Vec3f center = (max_pos_ + min_pos_) * 0.5f;
+    Vec3f half = (max_pos_ - min_pos_) * 0.5f;
+    for (u_int i = 0; i < 3; ++i) {
+      // 厚みのない方向
+      if (half(i) <= 0.0f) half(i) = 1.0f;
+    }
+    const float diagonal = std::max((max_pos_ - min_pos_).norm(), FLT_MIN);
+
+    float position_error = 0.0f;
+    float normal_error   = 1.0f;
+    packed_body.reserve(body.size());
+    for (const auto& b : body) {
+      PackedBody obj;
+      Vec3f pos(b.vertex.x, b.vertex.y, b.vertex.z);
+      Vec3f q = (pos - center).cwiseQuotient(half);
+      obj.x = static_cast<GLshort>(toSigned(q.x(), 16));
+      obj.y = static_cast<GLshort>(toSigned(q.y(), 16));
+      obj.z = static_cast<GLshort>(toSigned(q.z(), 16));
+      obj.w = 0;
+
+      Vec3f decoded(fromSigned(obj.x, 16), fromSigned(obj.y, 16), fromSigned(obj.z, 16));
+      decoded = decoded.cwiseProduct(half) + center;
+      position_error = std::max(position_error, (decoded - pos).norm() / diagonal);
+
+      obj.nx = obj.ny = obj.nz = obj.nw = 0;
+      if (has_normal_) {
+        Vec3f n(b.normal.x, b.normal.y, b.normal.z);
+        obj.nx = static_cast<GLbyte>(toSigned(n.x(), 8));
+        obj.ny = static_cast<GLbyte>(toSigned(n.y(), 8));
+        obj.nz = static_cast<GLbyte>(toSigned(n.z(), 8));
+
+        Vec3f decoded_n(fromSigned(obj.nx, 8), fromSigned(obj.ny, 8), fromSigned(obj.nz, 8));
+        if (n.norm() > 0.0f) {
+          normal_error = std::min(normal_error, n.normalized().dot(decoded_n.normalized()));
+        }
+      }
+
+      obj.u = obj.v = 0;
+      if (has_texture_) {
+        obj.u = static_cast<GLushort>(b.uv.u * 65535.0f + 0.5f);
+        obj.v = static_cast<GLushort>(b.uv.v * 65535.0f + 0.5f);
+      }
+      packed_body.push_back(obj);
+    }
+
+    const float normal_angle = rad2deg(std::acos(std::min(normal_error, 1.0f)));
+    DOUT << "Mesh packed error position:" << position_error << " normal:" << normal_angle << std::endl;
+    if ((position_error > positionTolerance()) || (normal_angle > normalTolerance())) return false;
+
+    Eigen::Affine3f matrix = Eigen::Translation<GLfloat, 3>(center) * Eigen::Scaling(half);
+    position_matrix_ = matrix.matrix();
+    return true;
+  }
   
 };
 
@@ -0,0 +1,196 @@
+﻿
+#pragma once
+
+//
+// 全メッシュで共有する頂点バッファ
+// 内容が同じメッシュは同じ領域を使う
+// FIXME:OpenGL依存
+//
+
+#include "co_defines.hpp"
+#include <vector>
+#include <unordered_map>
+#include <cstring>
+#include <algorithm>
+#include <cassert>
+#include <boost/noncopyable.hpp>
+#include "co_glState.hpp"
+
+
+namespace ngs {
+
+class MeshBuffer : private boost::noncopyable {
+public:
+  // バッファ内の位置(バイト単位)
+  // TIPS:ES 2.0にはベース頂点付きの描画がないので、
+  //      頂点属性のオフセットにvertex_offsetを足して使う
+  struct Range {
+    size_t vertex_offset;
+    size_t index_offset;
+  };
+
+  
+private:
+  enum {
+    // 頂点属性とインデックスのアライメント
+    ALIGNMENT = 4,
+  };
+  
+  struct Entry {
+    Range range;
+    size_t vertex_bytes;
+    size_t index_bytes;
+    u_int vertex_hash;
+    u_int index_hash;
+  };
+
+  GLuint vertex_vbo_;
+  GLuint index_vbo_;
+
+  // 再転送と重複判定の為に内容を保持しておく
+  // TIPS:finish()で破棄する
+  std::vector<u_char> vertex_data_;
+  std::vector<u_char> index_data_;
+  size_t vertex_size_;
+  size_t index_size_;
+  size_t vertex_capacity_;
+  size_t index_capacity_;
+  bool finished_;
+  
+  std::unordered_multimap<u_int, Entry> entries_;
+  // 重複していた為に確保しなかったバイト数
+  size_t shared_bytes_;
+
+  
+public:
+  MeshBuffer() :
+    vertex_size_(0),
+    index_size_(0),
+    vertex_capacity_(0),
+    index_capacity_(0),
+    finished_(false),
+    shared_bytes_(0)
+  {
+    DOUT << "MeshBuffer()" << std::endl;
+    
+    glGenBuffers(1, &vertex_vbo_);
+    glGenBuffers(1, &index_vbo_);
+  }
+
+  ~MeshBuffer() {
+    DOUT << "~MeshBuffer()" << std::endl;
+
+    gl_state.deleteBuffer(vertex_vbo_);
+    gl_state.deleteBuffer(index_vbo_);
+  }
+
+  
+  // 頂点とインデックスを追加して、その位置を返す
+  // 同じ内容が既にあればその位置を返す
+  Range add(const void* vertex, const size_t vertex_bytes,
+            const void* index, const size_t index_bytes) {
+    const u_int vertex_hash = hashData(2166136261u, vertex, vertex_bytes);
+    const u_int index_hash  = hashData(2166136261u, index, index_bytes);
+    const u_int hash = vertex_hash ^ (index_hash * 16777619u);
+
+    auto range = entries_.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      const Entry& entry = it->second;
+      // TIPS:finish()の後は内容が無いので、大きさとハッシュ値だけで判定する
+      if ((entry.vertex_bytes == vertex_bytes)
+          && (entry.index_bytes == index_bytes)
+          && (entry.vertex_hash == vertex_hash)
+          && (entry.index_hash == index_hash)
+          && (finished_
+              || (!std::memcmp(&vertex_data_[entry.range.vertex_offset], vertex, vertex_bytes)
+                  && !std::memcmp(&index_data_[entry.range.index_offset], index, index_bytes)))) {
+        shared_bytes_ += vertex_bytes + index_bytes;
+        DOUT << "MeshBuffer shared:" << vertex_bytes + index_bytes << " bytes" << std::endl;
+        return entry.range;
+      }
+    }
+
+    Entry entry;
+    entry.vertex_bytes = vertex_bytes;
+    entry.index_bytes  = index_bytes;
+    entry.vertex_hash  = vertex_hash;
+    entry.index_hash   = index_hash;
+    entry.range.vertex_offset = append(GL_ARRAY_BUFFER, vertex_vbo_, vertex_data_, vertex_size_, vertex_capacity_, vertex, vertex_bytes);
+    entry.range.index_offset  = append(GL_ELEMENT_ARRAY_BUFFER, index_vbo_, index_data_, index_size_, index_capacity_, index, index_bytes);
+    entries_.insert(std::make_pair(hash, entry));
+    
+    return entry.range;
+  }
+
+  // 読み込みが済んだらCPU側の内容を破棄する
+  // TIPS:以降のadd()は確保済みの領域に収まる範囲で行うこと
+  void finish() {
+    if (finished_) return;
+    DOUT << "MeshBuffer finish:" << vertex_data_.capacity() + index_data_.capacity() << " bytes freed" << std::endl;
+
+    std::vector<u_char>().swap(vertex_data_);
+    std::vector<u_char>().swap(index_data_);
+    finished_ = true;
+  }
+  
+  GLuint vertexVbo() const { return vertex_vbo_; }
+  GLuint indexVbo() const { return index_vbo_; }
+
+  // 使用中のバイト数
+  size_t bytes() const { return vertex_size_ + index_size_; }
+  size_t sharedBytes() const { return shared_bytes_; }
+
+  
+private:
+  static u_int hashData(u_int hash, const void* data, const size_t bytes) {
+    // FNV-1a
+    const u_char* p = static_cast<const u_char*>(data);
+    for (size_t i = 0; i < bytes; ++i) {
+      hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+  }
+  
+  // 末尾に追加して、その位置を返す
+  // TIPS:足りなくなったら倍の大きさで確保し直して全体を転送する
+  size_t append(const GLenum target, const GLuint vbo,
+                std::vector<u_char>& data, size_t& size, size_t& capacity,
+                const void* src, const size_t bytes) {
+    const size_t offset = (size + ALIGNMENT - 1) & ~static_cast<size_t>(ALIGNMENT - 1);
+    size = offset + bytes;
+
+    gl_state.buffer(target, vbo);
+    if (size > capacity) {
+      if (finished_) {
+        // 内容を破棄した後は、GPU側から読み戻して転送し直す
+        // FIXME:ES 2.0では読み戻せない
+        DOUT << "MeshBuffer grows after finish():" << size << " bytes" << std::endl;
+        assert(0);
+#if !(TARGET_OS_IPHONE)
+        data.resize(offset);
+        if (offset > 0) glGetBufferSubData(target, 0, offset, &data[0]);
+#endif
+      }
+      data.resize(size);
+      if (bytes > 0) std::memcpy(&data[offset], src, bytes);
+
+      capacity = std::max(size, capacity * 2);
+      glBufferData(target, capacity, 0, GL_STATIC_DRAW);
+      glBufferSubData(target, 0, size, &data[0]);
+      if (finished_) std::vector<u_char>().swap(data);
+    }
+    else if (bytes > 0) {
+      if (!finished_) {
+        data.resize(size);
+        std::memcpy(&data[offset], src, bytes);
+      }
+      glBufferSubData(target, offset, bytes, src);
+    }
+    gl_state.buffer(target, 0);
+    
+    return offset;
+  }
+  
+};
+
+}
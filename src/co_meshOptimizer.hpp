@@ -0,0 +1,180 @@
+﻿
+#pragma once
+
+//
+// メッシュの最適化
+// 頂点キャッシュが効くように面を並べ替え、頂点も使われる順に並べ替える
+// SEE:Tom Forsyth "Linear-Speed Vertex Cache Optimisation"
+//
+
+#include "co_defines.hpp"
+#include <vector>
+#include <deque>
+#include <cmath>
+#include <climits>
+#include <cfloat>
+#include <algorithm>
+
+
+namespace ngs {
+
+class MeshOptimizer {
+  enum {
+    // 並べ替えで想定するキャッシュの大きさ
+    CACHE_SIZE = 32,
+  };
+
+  // 頂点のスコア
+  // キャッシュに残っているほど、残りの面が少ないほど高い
+  static float vertexScore(const int cache_pos, const u_int remain) {
+    if (remain == 0) return -1.0f;
+
+    float score = 0.0f;
+    if (cache_pos >= 0) {
+      if (cache_pos < 3) {
+        // 直前の面で使った頂点は少し低めにする
+        score = 0.75f;
+      }
+      else {
+        const float scale = 1.0f / (CACHE_SIZE - 3);
+        score = std::pow(1.0f - (cache_pos - 3) * scale, 1.5f);
+      }
+    }
+    score += 2.0f / std::sqrt(static_cast<float>(remain));
+    return score;
+  }
+
+  
+public:
+  // FIFOキャッシュでの1面あたりの頂点処理数(Average Cache Miss Ratio)
+  static float acmr(const std::vector<u_int>& indices, const u_int cache_size = 16) {
+    if (indices.empty()) return 0.0f;
+    
+    std::deque<u_int> cache;
+    u_int miss = 0;
+    for (const auto index : indices) {
+      if (std::find(cache.begin(), cache.end(), index) != cache.end()) continue;
+      
+      ++miss;
+      cache.push_back(index);
+      if (cache.size() > cache_size) cache.pop_front();
+    }
+    return static_cast<float>(miss) / (indices.size() / 3);
+  }
+
+  // 面の並べ替え
+  static void optimizeFaces(std::vector<u_int>& indices, const u_int vertex_num) {
+    const u_int tri_num = static_cast<u_int>(indices.size() / 3);
+    if (tri_num == 0) return;
+
+    // 頂点ごとの面のリスト
+    std::vector<u_int> remain(vertex_num, 0);
+    for (const auto index : indices) ++remain[index];
+
+    std::vector<u_int> offset(vertex_num + 1, 0);
+    for (u_int i = 0; i < vertex_num; ++i) offset[i + 1] = offset[i] + remain[i];
+
+    std::vector<u_int> tri_list(indices.size());
+    {
+      std::vector<u_int> count(vertex_num, 0);
+      for (u_int i = 0; i < indices.size(); ++i) {
+        const u_int v = indices[i];
+        tri_list[offset[v] + count[v]] = i / 3;
+        ++count[v];
+      }
+    }
+
+    std::vector<int> cache_pos(vertex_num, -1);
+    std::vector<float> vertex_score(vertex_num);
+    for (u_int i = 0; i < vertex_num; ++i) vertex_score[i] = vertexScore(-1, remain[i]);
+
+    std::vector<float> tri_score(tri_num);
+    std::vector<bool> added(tri_num, false);
+    for (u_int i = 0; i < tri_num; ++i) {
+      tri_score[i] = vertex_score[indices[i * 3]] + vertex_score[indices[i * 3 + 1]] + vertex_score[indices[i * 3 + 2]];
+    }
+
+    std::vector<u_int> result;
+    result.reserve(indices.size());
+    std::vector<u_int> cache;
+    cache.reserve(CACHE_SIZE + 3);
+    
+    int best = -1;
+    while (result.size() < indices.size()) {
+      if (best < 0) {
+        // キャッシュから候補が見つからない時は全体から探す
+        float best_score = -FLT_MAX;
+        for (u_int i = 0; i < tri_num; ++i) {
+          if (!added[i] && (tri_score[i] > best_score)) {
+            best_score = tri_score[i];
+            best = i;
+          }
+        }
+      }
+
+      added[best] = true;
+      std::vector<u_int> new_cache;
+      new_cache.reserve(CACHE_SIZE + 3);
+      for (u_int j = 0; j < 3; ++j) {
+        const u_int v = indices[best * 3 + j];
+        result.push_back(v);
+        new_cache.push_back(v);
+
+        // 頂点の面リストから取り除く
+        u_int* begin = &tri_list[offset[v]];
+        u_int* it    = std::find(begin, begin + remain[v], static_cast<u_int>(best));
+        std::swap(*it, begin[remain[v] - 1]);
+        --remain[v];
+      }
+
+      // 使った頂点をキャッシュの先頭へ
+      for (const auto v : cache) {
+        if (std::find(new_cache.begin(), new_cache.end(), v) == new_cache.end()) new_cache.push_back(v);
+      }
+
+      for (u_int i = 0; i < new_cache.size(); ++i) {
+        const u_int v = new_cache[i];
+        cache_pos[v]    = (i < CACHE_SIZE) ? static_cast<int>(i) : -1;
+        vertex_score[v] = vertexScore(cache_pos[v], remain[v]);
+      }
+
+      // スコアが変わった面から次の候補を探す
+      best = -1;
+      float best_score = -FLT_MAX;
+      for (const auto v : new_cache) {
+        for (u_int k = 0; k < remain[v]; ++k) {
+          const u_int t = tri_list[offset[v] + k];
+          tri_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+          if (tri_score[t] > best_score) {
+            best_score = tri_score[t];
+            best = t;
+          }
+        }
+      }
+
+      if (new_cache.size() > CACHE_SIZE) new_cache.resize(CACHE_SIZE);
+      cache.swap(new_cache);
+    }
+
+    indices.swap(result);
+  }
+
+  // 頂点を最初に使われる順に並べ替える
+  // 戻り値:古い番号→新しい番号
+  static std::vector<u_int> optimizeVertices(std::vector<u_int>& indices, const u_int vertex_num) {
+    std::vector<u_int> remap(vertex_num, UINT_MAX);
+    u_int next = 0;
+    for (auto& index : indices) {
+      if (remap[index] == UINT_MAX) remap[index] = next++;
+      index = remap[index];
+    }
+
+    // 使われていない頂点は末尾へ
+    for (auto& index : remap) {
+      if (index == UINT_MAX) index = next++;
+    }
+    return remap;
+  }
+};
+
+}
@@ -0,0 +1,247 @@
+﻿
+#pragma once
+
+//
+// メッシュの簡略化(LOD生成用)
+// Quadric Error Metricsで誤差の少ない辺から縮退させる
+// TIPS:頂点は元の頂点から選ぶので、頂点バッファはそのまま共有できる
+// SEE:Garland & Heckbert "Surface Simplification Using Quadric Error Metrics"
+//
+
+#include "co_defines.hpp"
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cfloat>
+#include "co_vector.hpp"
+
+
+namespace ngs {
+
+class MeshSimplifier {
+  // 4x4の対称行列
+  struct Quadric {
+    double a00, a01, a02, a03;
+    double a11, a12, a13;
+    double a22, a23;
+    double a33;
+
+    Quadric() :
+      a00(0), a01(0), a02(0), a03(0),
+      a11(0), a12(0), a13(0),
+      a22(0), a23(0),
+      a33(0)
+    {}
+
+    // 平面 ax + by + cz + d = 0 からの距離の二乗
+    Quadric(const double a, const double b, const double c, const double d, const double weight) :
+      a00(a * a * weight), a01(a * b * weight), a02(a * c * weight), a03(a * d * weight),
+      a11(b * b * weight), a12(b * c * weight), a13(b * d * weight),
+      a22(c * c * weight), a23(c * d * weight),
+      a33(d * d * weight)
+    {}
+
+    Quadric& operator+=(const Quadric& rhs) {
+      a00 += rhs.a00; a01 += rhs.a01; a02 += rhs.a02; a03 += rhs.a03;
+      a11 += rhs.a11; a12 += rhs.a12; a13 += rhs.a13;
+      a22 += rhs.a22; a23 += rhs.a23;
+      a33 += rhs.a33;
+      return *this;
+    }
+
+    double error(const Vec3f& v) const {
+      const double x = v.x();
+      const double y = v.y();
+      const double z = v.z();
+      return a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+           + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+           + a22 * z * z + 2 * a23 * z
+           + a33;
+    }
+  };
+
+  struct Collapse {
+    u_int from;
+    u_int to;
+    double cost;
+
+    bool operator<(const Collapse& rhs) const { return cost < rhs.cost; }
+  };
+
+  static Vec3f triangleNormal(const Vec3f& p0, const Vec3f& p1, const Vec3f& p2) {
+    return (p1 - p0).cross(p2 - p0);
+  }
+  
+  
+public:
+  // 面の数を減らしたインデックスを返す
+  // target_indices: 目標のインデックス数
+  // max_error:      許容する誤差(AABBの対角線に対する比率)
+  static std::vector<u_int> simplify(const std::vector<Vec3f>& positions,
+                                     const std::vector<u_int>& indices,
+                                     const size_t target_indices, const float max_error) {
+    const u_int vertex_num = static_cast<u_int>(positions.size());
+    std::vector<u_int> result(indices);
+    if (result.size() <= target_indices) return result;
+
+    // 許容誤差の二乗
+    double limit = 0.0;
+    {
+      Vec3f min_pos(FLT_MAX, FLT_MAX, FLT_MAX);
+      Vec3f max_pos(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+      for (const auto& p : positions) {
+        min_pos = min_pos.cwiseMin(p);
+        max_pos = max_pos.cwiseMax(p);
+      }
+      const double tolerance = (max_pos - min_pos).norm() * max_error;
+      limit = tolerance * tolerance;
+    }
+
+    // 頂点ごとに、接している面の平面からの誤差を集める
+    std::vector<Quadric> quadrics(vertex_num);
+    for (size_t i = 0; i < result.size(); i += 3) {
+      const Vec3f& p0 = positions[result[i]];
+      Vec3f n = triangleNormal(p0, positions[result[i + 1]], positions[result[i + 2]]);
+      const float area = n.norm();
+      if (area <= 0.0f) continue;
+
+      // TIPS:面積で重み付けしないので、誤差は平面からの距離の二乗の和になる
+      n /= area;
+      const Quadric q(n.x(), n.y(), n.z(), -n.dot(p0), 1.0);
+      for (u_int j = 0; j < 3; ++j) quadrics[result[i + j]] += q;
+    }
+
+    // 境界の頂点は動かさない
+    // TIPS:UVや法線の切れ目は頂点が分かれているので、ここで境界として扱われる
+    std::vector<bool> locked(vertex_num, false);
+    {
+      std::unordered_map<unsigned long long, u_int> edges;
+      for (size_t i = 0; i < result.size(); i += 3) {
+        for (u_int j = 0; j < 3; ++j) {
+          ++edges[edgeKey(result[i + j], result[i + (j + 1) % 3])];
+        }
+      }
+      for (const auto& edge : edges) {
+        if (edge.second != 1) continue;
+        locked[static_cast<u_int>(edge.first >> 32)]          = true;
+        locked[static_cast<u_int>(edge.first & 0xffffffffu)] = true;
+      }
+    }
+
+    std::vector<u_int> collapse_to(vertex_num);
+    std::vector<bool> touched(vertex_num);
+    while (result.size() > target_indices) {
+      // 縮退させる辺の候補
+      std::vector<Collapse> candidates;
+      candidates.reserve(result.size());
+      for (size_t i = 0; i < result.size(); i += 3) {
+        for (u_int j = 0; j < 3; ++j) {
+          const u_int v0 = result[i + j];
+          const u_int v1 = result[i + (j + 1) % 3];
+          // TIPS:内側の辺は2回出てくるので片方だけ使う
+          if (v0 > v1) continue;
+
+          Quadric q = quadrics[v0];
+          q += quadrics[v1];
+          const double cost01 = locked[v0] ? DBL_MAX : q.error(positions[v1]);
+          const double cost10 = locked[v1] ? DBL_MAX : q.error(positions[v0]);
+          if ((cost01 > limit) && (cost10 > limit)) continue;
+
+          const Collapse collapse = { (cost01 <= cost10) ? v0 : v1,
+                                      (cost01 <= cost10) ? v1 : v0,
+                                      std::min(cost01, cost10) };
+          candidates.push_back(collapse);
+        }
+      }
+      if (candidates.empty()) break;
+      std::sort(candidates.begin(), candidates.end());
+
+      // 頂点ごとの面のリスト
+      std::vector<u_int> offset(vertex_num + 1, 0);
+      for (const auto index : result) ++offset[index + 1];
+      for (u_int i = 0; i < vertex_num; ++i) offset[i + 1] += offset[i];
+      std::vector<u_int> tri_list(result.size());
+      {
+        std::vector<u_int> count(offset.begin(), offset.end() - 1);
+        for (size_t i = 0; i < result.size(); ++i) {
+          tri_list[count[result[i]]++] = static_cast<u_int>(i / 3);
+        }
+      }
+
+      for (u_int i = 0; i < vertex_num; ++i) collapse_to[i] = i;
+      std::fill(touched.begin(), touched.end(), false);
+      
+      const size_t goal = (result.size() - target_indices) / 3;
+      size_t removed = 0;
+      for (const auto& c : candidates) {
+        if (touched[c.from] || touched[c.to]) continue;
+        if (flipped(positions, result, &tri_list[offset[c.from]], &tri_list[offset[c.from + 1]], c.from, c.to)) continue;
+
+        collapse_to[c.from] = c.to;
+        quadrics[c.to] += quadrics[c.from];
+
+        // TIPS:同じ回で周りの頂点を動かすと裏返りの判定が狂うので、次の回に回す
+        for (u_int k = offset[c.from]; k < offset[c.from + 1]; ++k) {
+          const u_int t = tri_list[k];
+          bool shared = false;
+          for (u_int j = 0; j < 3; ++j) {
+            touched[result[t * 3 + j]] = true;
+            if (result[t * 3 + j] == c.to) shared = true;
+          }
+          if (shared) ++removed;
+        }
+        if (removed >= goal) break;
+      }
+      if (removed == 0) break;
+
+      // 縮退した面を取り除く
+      size_t write = 0;
+      for (size_t i = 0; i < result.size(); i += 3) {
+        const u_int v0 = collapse_to[result[i]];
+        const u_int v1 = collapse_to[result[i + 1]];
+        const u_int v2 = collapse_to[result[i + 2]];
+        if ((v0 == v1) || (v1 == v2) || (v2 == v0)) continue;
+
+        result[write++] = v0;
+        result[write++] = v1;
+        result[write++] = v2;
+      }
+      result.resize(write);
+    }
+
+    return result;
+  }
+
+  
+private:
+  static unsigned long long edgeKey(const u_int v0, const u_int v1) {
+    const u_int a = std::min(v0, v1);
+    const u_int b = std::max(v0, v1);
+    return (static_cast<unsigned long long>(a) << 32) | b;
+  }
+
+  // fromをtoへ移した時に裏返る(または大きく向きが変わる)面があるか
+  static bool flipped(const std::vector<Vec3f>& positions, const std::vector<u_int>& indices,
+                      const u_int* begin, const u_int* end,
+                      const u_int from, const u_int to) {
+    for (const u_int* it = begin; it != end; ++it) {
+      const u_int* tri = &indices[*it * 3];
+      if ((tri[0] == to) || (tri[1] == to) || (tri[2] == to)) continue;
+
+      Vec3f p[3];
+      Vec3f moved[3];
+      for (u_int j = 0; j < 3; ++j) {
+        p[j]     = positions[tri[j]];
+        moved[j] = positions[(tri[j] == from) ? to : tri[j]];
+      }
+      const Vec3f n0 = triangleNormal(p[0], p[1], p[2]);
+      const Vec3f n1 = triangleNormal(moved[0], moved[1], moved[2]);
+      // TIPS:細長く潰れた面も向きが大きく変わるので、ここで弾かれる
+      if (n0.dot(n1) <= n0.norm() * n1.norm() * 0.25f) return true;
+    }
+    return false;
+  }
+  
+};
+
+}
@@ -109,6 +109,17 @@ std::string textFromTime(const float time_ms) {
 }
 
 
+// FNV-1aでハッシュ値を求める
+// hash: 続けて計算する時は前回の結果を渡す
+u_int hashBytes(const void* data, const size_t size, u_int hash = 2166136261u) {
+  const u_char* bytes = static_cast<const u_char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+
 // 被りにくい識別用の値を生成
 // FIXME:More betterな実装
 u_int createUniqueNumber() {
@@ -19,6 +19,7 @@
 #include <fstream>
 #include <deque>
 #include <memory>
+#include <boost/noncopyable.hpp>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
@@ -30,11 +31,18 @@
 
 namespace ngs {
 
-class Model {
+// 読み込んだモデルデータ
+// 生成後は書き換えず、全てのインスタンスで共有する
+class ModelAsset : private boost::noncopyable {
   std::deque<std::shared_ptr<Mesh> > meshes_;
   std::deque<Material> materials_;
-  Node root_node_;
+  // 描画用に平坦化した階層構造
+  NodeList nodes_;
   std::shared_ptr<TexMng> textures_;
+  std::shared_ptr<MeshBuffer> buffer_;
+  // モデル全体を囲む球(LODの選択に使う)
+  Vec3f center_;
+  float radius_;
 
   // 読み込みフラグ
   enum {
@@ -42,18 +50,30 @@ class Model {
                    aiProcess_Triangulate |
                    aiProcess_FlipUVs |
                    aiProcess_SortByPType |
-                   aiProcess_OptimizeMeshes
+                   aiProcess_OptimizeMeshes,
+
+    // 階層を動かさないモデル用
+    // TIPS:頂点をモデル座標系へ変換し、同じマテリアルのメッシュを1つにまとめる
+    //      描画はマテリアルごとに1回になる
+    baked_import_flags = import_flags | aiProcess_PreTransformVertices
   };
   
 public:
-  Model(const std::string& file_name, const std::string& path) :
-    textures_(std::make_shared<TexMng>())
+  // textures: 複数のモデルでテクスチャを共有する場合に指定
+  // buffer:   複数のモデルで頂点バッファを共有する場合に指定
+  // baked:    階層構造を焼き込む(ノードの行列を書き換えないモデル用)
+  ModelAsset(const std::string& file_name, const std::string& path,
+             const std::shared_ptr<TexMng>& textures = std::make_shared<TexMng>(),
+             const std::shared_ptr<MeshBuffer>& buffer = std::make_shared<MeshBuffer>(),
+             const bool baked = false) :
+    textures_(textures),
+    buffer_(buffer)
   {
-    DOUT << "Model()" << std::endl;
+    DOUT << "ModelAsset()" << std::endl;
 
     // Open Asset Importerを利用してモデルデータを読み込む
     Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path + file_name, import_flags);
+    const aiScene* scene = importer.ReadFile(path + file_name, baked ? baked_import_flags : import_flags);
     if (!scene) {
       DOUT << importer.GetErrorString() << std::endl;
     }
@@ -64,8 +84,33 @@ public:
     for (u_int i = 0; i < scene->mNumMeshes; ++i) {
       const aiMesh& scene_mesh = *(scene->mMeshes[i]);
       // TIPS:コンテナ内に直接Meshを生成する
-      meshes_.emplace_back(std::make_shared<Mesh>(scene_mesh));
+      meshes_.emplace_back(std::make_shared<Mesh>(scene_mesh, buffer_));
     }
+#ifdef _DEBUG
+    {
+      // 頂点の量子化で減ったバイト数
+      size_t bytes = 0;
+      size_t float_bytes = 0;
+      for (const auto& mesh : meshes_) {
+        bytes       += mesh->bytes();
+        float_bytes += mesh->floatBytes();
+      }
+      DOUT << "Model vertex:" << file_name << " " << float_bytes << "->" << bytes << " bytes" << std::endl;
+
+      // 面の並べ替えによるACMRの変化(面数で加重平均)
+      float before = 0.0f;
+      float after  = 0.0f;
+      u_int faces  = 0;
+      for (const auto& mesh : meshes_) {
+        before += mesh->acmrBefore() * mesh->faces();
+        after  += mesh->acmrAfter() * mesh->faces();
+        faces  += mesh->faces();
+      }
+      if (faces > 0) {
+        DOUT << "Model ACMR:" << file_name << " " << before / faces << "->" << after / faces << std::endl;
+      }
+    }
+#endif
 
     // マテリアル生成
     for (u_int i = 0; i < scene->mNumMaterials; ++i) {
@@ -74,102 +119,195 @@ public:
       // TIPS:コンテナ内に直接Materialを生成する
     }
     
-    // 階層構造を生成
-    root_node_.setup(scene->mRootNode);
+    // 階層構造を生成して平坦化
+    // TIPS:木構造は平坦化したら要らない
+    Node root_node;
+    root_node.setup(scene->mRootNode);
+    nodes_ = NodeList(root_node);
+
+    setupBounds();
   }
 
-  
-  // TIPS:ノード情報を生成しなおす為に自分でコピーする
-  Model(const Model& rhs) :
-    meshes_(rhs.meshes_),
-    materials_(rhs.materials_),
-    root_node_(rhs.root_node_),
-    textures_(rhs.textures_)
-  {
-    DOUT << "Model(& model)" << std::endl;
+  ~ModelAsset() {
+    DOUT << "~ModelAsset()" << std::endl;
   }
 
-  Model(Model&& rhs) :
-    meshes_(std::move(rhs.meshes_)),
-    materials_(std::move(rhs.materials_)),
-    root_node_(std::move(rhs.root_node_)),
-    textures_(std::move(rhs.textures_))
-  {
-    DOUT << "Model(&& model)" << std::endl;
+  
+  const std::deque<std::shared_ptr<Mesh> >& mesh() const { return meshes_; }
+  const std::deque<Material>& material() const { return materials_; }
+  const NodeList& nodes() const { return nodes_; }
+
+  // TIPS:テクスチャの管理はキャッシュなので、共有していても書き換えてよい
+  TexMng& textures() const { return *textures_; }
+
+  // 全メッシュの頂点とインデックスを持つバッファ
+  const MeshBuffer& meshBuffer() const { return *buffer_; }
+
+  const Vec3f& center() const { return center_; }
+  float radius() const { return radius_; }
+
+
+private:
+  // 各ノードのメッシュのAABBをモデル座標系でまとめる
+  void setupBounds() {
+    Vec3f min_pos(FLT_MAX, FLT_MAX, FLT_MAX);
+    Vec3f max_pos(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (const auto& node : nodes_.nodes()) {
+      for (const u_int mesh_index : node.mesh_indexes) {
+        const Mesh& mesh = *meshes_[mesh_index];
+        for (u_int i = 0; i < 8; ++i) {
+          const Vec4f corner((i & 1) ? mesh.maxPos().x() : mesh.minPos().x(),
+                             (i & 2) ? mesh.maxPos().y() : mesh.minPos().y(),
+                             (i & 4) ? mesh.maxPos().z() : mesh.minPos().z(),
+                             1.0f);
+          const Vec4f pos = node.matrix * corner;
+          min_pos = min_pos.cwiseMin(pos.head<3>());
+          max_pos = max_pos.cwiseMax(pos.head<3>());
+        }
+      }
+    }
+
+    if (min_pos.x() > max_pos.x()) {
+      // メッシュがない
+      center_ = Vec3f::Zero();
+      radius_ = 0.0f;
+      return;
+    }
+    center_ = (min_pos + max_pos) * 0.5f;
+    radius_ = (max_pos - min_pos).norm() * 0.5f;
   }
+};
+
+
+// モデルのインスタンス
+// 共有データへの参照と、マテリアルの上書き情報だけを持つ
+class Model {
+  std::shared_ptr<const ModelAsset> asset_;
+  // ノードの行列を書き換えた時だけ個別に持つ
+  std::shared_ptr<NodeList> nodes_;
+  MaterialOverride override_;
+  // 今のLOD
+  u_int lod_;
+
+  
+public:
+  explicit Model(const std::shared_ptr<const ModelAsset>& asset) :
+    asset_(asset),
+    lod_(0)
+  {}
 
-  ~Model() {
-    DOUT << "~Model()" << std::endl;
+  // LODを切り替える画面上の大きさ(画面の高さの半分に対する半径の比率)
+  static float lodSize(const u_int level) {
+    static const float size[] = { 0.0f, 0.25f, 0.1f };
+    return size[level];
   }
+  // 切り替えのちらつきを抑える幅
+  static float lodHysteresis() { return 0.2f; }
 
   
-  const std::deque<std::shared_ptr<Mesh> >& mesh() const { return meshes_; }
+  const ModelAsset& asset() const { return *asset_; }
+  
+  const std::deque<std::shared_ptr<Mesh> >& mesh() const { return asset_->mesh(); }
+  const std::deque<Material>& material() const { return asset_->material(); }
+  const MeshBuffer& meshBuffer() const { return asset_->meshBuffer(); }
 
-  const std::deque<Material>& material() const { return materials_; }
-  std::deque<Material>& material() { return materials_; }
+  const MaterialOverride& materialOverride() const { return override_; }
+  
+  const NodeList& nodes() const { return nodes_ ? *nodes_ : asset_->nodes(); }
 
-  const Node& rootNode() const { return root_node_; }
-  Node& rootNode() { return root_node_; }
+  // 書き換える為に個別の階層構造を用意する
+  NodeList& nodes() {
+    if (!nodes_) nodes_ = std::make_shared<NodeList>(asset_->nodes());
+    return *nodes_;
+  }
+
+  // 描画などに使う階層構造(書き換えがあれば行列を計算し直す)
+  const NodeList& updatedNodes() {
+    if (!nodes_) return asset_->nodes();
+    
+    nodes_->update();
+    return *nodes_;
+  }
 
   // モデルに含まれるポリゴン数を返す
   u_int numPolygon() const {
     u_int num = 0;
-    for (const auto mesh : meshes_) {
+    for (const auto mesh : asset_->mesh()) {
       num += mesh->faces();
     }
     return num;
   }
 
+  // 画面上の大きさからLODを選ぶ
+  // TIPS:切り替える大きさに幅を持たせて、境目で行き来しないようにする
+  u_int selectLod(const Mat4f& model_view, const Mat4f& projection) {
+    const Vec3f& center = asset_->center();
+    const Vec4f pos = model_view * Vec4f(center.x(), center.y(), center.z(), 1.0f);
+    const float w = projection.row(3).dot(pos);
+    if (w <= 0.0f) {
+      // カメラの後ろや近すぎる場合
+      lod_ = 0;
+      return lod_;
+    }
+
+    const Mat3f m = model_view.block(0, 0, 3, 3);
+    const float scale = m.colwise().norm().maxCoeff();
+    const float size  = asset_->radius() * scale * projection(1, 1) / w;
+
+    while ((lod_ > 0) && (size > lodSize(lod_) * (1.0f + lodHysteresis()))) --lod_;
+    while (((lod_ + 1) < Mesh::LOD_NUM) && (size < lodSize(lod_ + 1) * (1.0f - lodHysteresis()))) ++lod_;
+    return lod_;
+  }
+
+  u_int lod() const { return lod_; }
+
   // モデルに含まれる全階層数を返す
   u_int numNode() const {
-    return root_node_.numNode();
+    return static_cast<u_int>(nodes().size());
   }
 
 
-  // マテリアルの反射色を書き換える
+  // マテリアルの反射色を置き換える
   static void materialDiffuseColor(Model& model, const Vec3f& color) {
-    std::deque<Material>& materials = model.material();
-    for (Material& material : materials) {
-      material.diffuse(color);
-    }
+    model.override_.diffuse         = color;
+    model.override_.replace_diffuse = true;
+  }
+
+  // マテリアルの反射色に係数を掛ける
+  static void materialDiffuseRate(Model& model, const float rate) {
+    model.override_.diffuse_rate = rate;
+  }
+
+  // マテリアルの反射色に色を加える
+  static void materialDiffuseAdd(Model& model, const Vec3f& color) {
+    model.override_.diffuse_add = color;
   }
   
-  // マテリアルの発光色を書き換える
+  // マテリアルの発光色を置き換える
   static void materialEmissiveColor(Model& model, const Vec3f& color) {
-    std::deque<Material>& materials = model.material();
-    for (Material& material : materials) {
-      material.emissive(color);
-    }
+    materialEmissiveColor(model, 0.0f, color);
   }
   
-  // マテリアルの発光色を書き換える(オリジナルあり)
-  static void materialEmissiveColor(Model& model, const std::deque<Material>& original, const Vec3f& color) {
-    std::deque<Material>& materials = model.material();
-    for (size_t i = 0; i < materials.size(); ++i) {
-      materials[i].emissive(original[i].emissive() + color);
-    }
+  // マテリアルの発光色を書き換える(元の色 * rate + color)
+  static void materialEmissiveColor(Model& model, const float rate, const Vec3f& color) {
+    model.override_.emissive_rate = rate;
+    model.override_.emissive_add  = color;
   }
 
-  // マテリアルのスペキュラ色を書き換える
+  // マテリアルのスペキュラ色を置き換える
   static void materialSpecularColor(Model& model, const Vec3f& color) {
-    std::deque<Material>& materials = model.material();
-    for (Material& material : materials) {
-      material.specular(color);
-    }
+    model.override_.specular         = color;
+    model.override_.replace_specular = true;
   }
 
   // マテリアルのテクスチャを書き換える
   void materialTexture(const std::string& file_name) {
-    TexMng::TexPtr texture = textures_->read(file_name);
-
-    for (Material& material : materials_) {
-      material.texture(texture);
-    }
+    override_.texture = asset_->textures().read(file_name);
   }
 
   // テクスチャ読むだけ
   void readTexture(const std::string& file_name) {
-    textures_->read(file_name);
+    asset_->textures().read(file_name);
   }
   
 };
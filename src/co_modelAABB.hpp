@@ -29,7 +29,7 @@ private:
   
 public:
   explicit ModelAABB(const Model& model) {
-    checkMeshVolume(model.rootNode(), Mat4f::Identity(), model.mesh());
+    checkMeshVolume(model.nodes(), model.mesh());
   }
 
   const Body& volume(const std::string& name) const {
@@ -53,17 +53,24 @@ public:
     return volume_;
   }
 
-  void updateMatrix(const Model& model) {
-    updateNodeMatrix(model.rootNode(), Mat4f::Identity());
+  // 平坦化した階層構造のキャッシュ済み行列を使う
+  void updateMatrix(Model& model) {
+    for (const auto& node : model.updatedNodes().nodes()) {
+      auto it = volume_.find(node.name);
+      // 全てのNodeがAABBを持っているとは限らない
+      if (it != volume_.end()) {
+        it->second.matrix = node.matrix;
+      }
+    }
   }
 
   
 private:
-  void checkMeshVolume(const Node& node, const Mat4f parent_matrix, const std::deque<std::shared_ptr<Mesh> >& meshes) {
-    Mat4f current_matrix = parent_matrix * node.matrix();
-
-    const std::deque<u_int>& mesh_index = node.meshIndexes();
-    if (!mesh_index.empty()) {
+  void checkMeshVolume(const NodeList& node_list, const std::deque<std::shared_ptr<Mesh> >& meshes) {
+    for (const auto& node : node_list.nodes()) {
+      const std::deque<u_int>& mesh_index = node.mesh_indexes;
+      if (mesh_index.empty()) continue;
+      
       // FIXME:最小値、最大値はC++的な定義がある
       Vec3f min_pos(FLT_MAX, FLT_MAX, FLT_MAX);
       Vec3f max_pos(-FLT_MAX, -FLT_MAX, -FLT_MAX);
@@ -83,37 +90,15 @@ private:
       }
 
       Body body = {
-        current_matrix,
+        node.matrix,
         {
           (min_pos + max_pos) / 2.0f,
           (max_pos - min_pos) / 2.0f
         }
       };
-      volume_.insert(std::unordered_map<std::string, Body>::value_type(node.name(), body));
-    }
-
-    // 再帰的に子ノードのAABBも作成
-    const std::vector<Node>& child = node.childs();
-    for (const Node& child_node : child) {
-      checkMeshVolume(child_node, current_matrix, meshes);
+      volume_.insert(std::unordered_map<std::string, Body>::value_type(node.name, body));
     }
   }
-
-  void updateNodeMatrix(const Node& node, Mat4f parent_matrix) {
-    Mat4f current_matrix = parent_matrix * node.matrix();
-    auto it = volume_.find(node.name());
-    // 全てのNodeがAABBを持っているとは限らない
-    if (it != volume_.end()) {
-      it->second.matrix = current_matrix;
-    }
-    
-    // 再帰的に子ノードの行列も更新
-    const std::vector<Node>& child = node.childs();
-    for (const Node& child_node : child) {
-      updateNodeMatrix(child_node, current_matrix);
-    }
-  }
-  
   
 };
 
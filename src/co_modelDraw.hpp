@@ -5,28 +5,35 @@
 // Model表示
 //
 
+#include <algorithm>
 #include "co_model.hpp"
 #include "co_easyShader.hpp"
+#include "co_glState.hpp"
 
 
 namespace ngs {
 
 // メッシュの描画
+// TIPS:頂点バッファは全メッシュで共有しているので、バインドはmodelDrawでまとめて行う
 void meshDraw(const Mesh& mesh, const EasyShader& shader,
-              const bool use_texture, const bool lighting) {
-  glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo(Mesh::ARRAY));
-
+              const bool use_texture, const bool lighting,
+              u_int lod = 0) {
+  // TIPS:頂点の形式はメッシュごとに異なる(量子化しているかどうか)
+  const GLsizei stride = mesh.stride();
+  
   // 頂点
   GLint position_hdl = shader.attrib("position");
   glEnableVertexAttribArray(position_hdl);
-  glVertexAttribPointer(position_hdl, 3, GL_FLOAT, GL_FALSE, sizeof(Mesh::Body), 0);
+  const Mesh::Attrib position = mesh.position();
+  glVertexAttribPointer(position_hdl, position.size, position.type, position.normalized, stride, position.offset);
 
   // 法線
   GLint normal_hdl = 0;
   if (lighting) {
     normal_hdl = shader.attrib("normal");
     glEnableVertexAttribArray(normal_hdl);
-    glVertexAttribPointer(normal_hdl, 3, GL_FLOAT, GL_FALSE, sizeof(Mesh::Body), (GLvoid *)offsetof(Mesh::Body, normal));
+    const Mesh::Attrib normal = mesh.normal();
+    glVertexAttribPointer(normal_hdl, normal.size, normal.type, normal.normalized, stride, normal.offset);
   }
 
   // UV(テクスチャがあれば)
@@ -34,16 +41,14 @@ void meshDraw(const Mesh& mesh, const EasyShader& shader,
   if (use_texture) {
     uv_hdl = shader.attrib("uv");
     glEnableVertexAttribArray(uv_hdl);
-    glVertexAttribPointer(uv_hdl, 2, GL_FLOAT, GL_FALSE, sizeof(Mesh::Body), (GLvoid *)offsetof(Mesh::Body, uv));
+    const Mesh::Attrib uv = mesh.uv();
+    glVertexAttribPointer(uv_hdl, uv.size, uv.type, uv.normalized, stride, uv.offset);
   }
 
   // 面ごとの頂点インデックス配列を使って描画
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.vbo(Mesh::ELEMENT_ARRAY));
-  glDrawElements(GL_TRIANGLES, mesh.points(), GL_UNSIGNED_SHORT, 0);
-
-  // 割り当てを解除しておく
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  // TIPS:簡略化できなかったメッシュはLODの数が少ない
+  lod = std::min(lod, mesh.lods() - 1);
+  glDrawElements(GL_TRIANGLES, mesh.points(lod), mesh.indexType(), mesh.indexOffset(lod));
 
   // 頂点バッファへの関連付けも解除
   glDisableVertexAttribArray(position_hdl);
@@ -99,61 +104,46 @@ void setupShadowMatrix(const EasyShader& shader, const Mat4f& matrix) {
 
 
 // マテリアルごとのシェーダーのセットアップ
+// 色とテクスチャはインスタンスごとの上書きを合成して使う
 void setupShader(const EasyShader& shader,
-                 const Material& material,
+                 const Material& material, const MaterialOverride& material_override,
                  const bool use_texture, const bool lighting) {
   if (use_texture) {
     glUniform1i(shader.uniform("sampler"), 0);
-    material.bindTexture();
+    const Texture& texture = material_override.bindTexture(material);
+
+    // アトラスの場合はその中の領域を使う
+    const Vec4f& uv_rect = texture.uvRect();
+    glUniform4f(shader.uniform("uv_rect"), uv_rect.x(), uv_rect.y(), uv_rect.z(), uv_rect.w());
   }
 
   {
-    const Vec3f& diffuse = material.diffuse();
+    Vec3f diffuse = material_override.diffuseColor(material);
     glUniform4f(shader.uniform("material_diffuse"), diffuse.x(), diffuse.y(), diffuse.z(), 1.0f);
   }
 
   {
-    const Vec3f& emissive = material.emissive();
+    Vec3f emissive = material_override.emissiveColor(material);
     glUniform4f(shader.uniform("material_emissive"), emissive.x(), emissive.y(), emissive.z(), 0.0f);
   }
   
   if (lighting) {
-    const Vec3f& specular = material.specular();
+    const Vec3f& specular = material_override.specularColor(material);
     glUniform4f(shader.uniform("material_specular"), specular.x(), specular.y(), specular.z(), 0.0f);
     glUniform1f(shader.uniform("material_shininess"), material.shininess());
   }
 }
 
 // ノードに含まれるメッシュを描画
-// ノードの親子関係から再帰的に呼ばれる
-void nodeDraw(Node& node,
-              const Mat4f& matrix,
+void nodeDraw(const NodeList::Body& node,
+              const Mat4f& model, const Mat3f& normal,
               const EasyShader& shader_color, const EasyShader& shader_texture,
-              const bool lighting,
+              const bool lighting, const u_int lod,
               const std::deque<std::shared_ptr<Mesh> >& mesh,
-              const std::deque<Material>& material) {
-  // ノードが非表示な場合は子ノードもまとめて表示しない
-  if (!node.display()) return;
-  
-  pushMatrix();
-  multMatrix(node.matrix());
-  Mat4f model_local = matrix * node.matrix();
-
-  {
-    Mat4f& model = getModelMatrix();
-
-    // 光源はモデル座標系で行う
-    Mat3f normal = model_local.block(0, 0, 3, 3);
-
-    shader_color();
-    setupModelingMatrix(shader_color, model, normal, lighting);
-
-    shader_texture();
-    setupModelingMatrix(shader_texture, model, normal, lighting);
-  }
-
+              const std::deque<Material>& material,
+              const MaterialOverride& material_override) {
   // ノードに含まれるメッシュを順番に描画
-  for (const u_int mesh_index : node.meshIndexes()) {
+  for (const u_int mesh_index : node.mesh_indexes) {
     const Mesh&     l_mesh     = *mesh[mesh_index];
     const Material& l_material = material[l_mesh.materialIndex()];
 
@@ -161,98 +151,91 @@ void nodeDraw(Node& node,
     const EasyShader& shader = use_texture ? shader_texture : shader_color;
 
     shader();
-    setupShader(shader, l_material, use_texture, lighting);
+    // TIPS:量子化した位置を戻す行列はメッシュごとに違う
+    setupModelingMatrix(shader, model * l_mesh.positionMatrix(), normal, lighting);
+    setupShader(shader, l_material, material_override, use_texture, lighting);
 
-    meshDraw(l_mesh, shader, use_texture, lighting);
+    meshDraw(l_mesh, shader, use_texture, lighting, lod);
       
     if (use_texture) {
-      glBindTexture(GL_TEXTURE_2D, 0);
+      gl_state.texture(0);
     }
   }
-    
-  // 子ノードを再帰的に描画
-  for (auto& child : node.childs()) {
-    nodeDraw(child,
-             model_local,
-             shader_color, shader_texture,
-             lighting,
-             mesh, material);
-  }
-  
-  popMatrix();
 }
 
 
 // モデルの描画
+// 平坦化した階層構造を先頭から順に描画する
 void modelDraw(Model& model,
                const Mat4f& matrix,
                const EasyShader& shader_color, const EasyShader& shader_texture,
                const bool lighting = false) {
-  pushMatrix();
-  multMatrix(matrix);
-  
-  nodeDraw(model.rootNode(),
-           matrix,
-           shader_color, shader_texture,
-           lighting,
-           model.mesh(), model.material());
+  // 書き換えがあった時だけ階層の行列を計算し直す
+  const NodeList& node_list = model.updatedNodes();
+
+  // カメラ行列との積は全ノード共通
+  Mat4f model_view = getModelMatrix() * matrix;
+
+  // 画面上の大きさでLODを選ぶ
+  const u_int lod = model.selectLod(model_view, getProjectionMatrix());
+
+  // 頂点バッファはモデル内の全メッシュで共通
+  const MeshBuffer& buffer = model.meshBuffer();
+  gl_state.arrayBuffer(buffer.vertexVbo());
+  gl_state.elementArrayBuffer(buffer.indexVbo());
+
+  const auto& nodes = node_list.nodes();
+  for (u_int i = 0; i < nodes.size(); ) {
+    const auto& node = nodes[i];
+    // ノードが非表示な場合は子ノードもまとめて表示しない
+    if (!node.display) {
+      i = node.end;
+      continue;
+    }
+    
+    // 光源はモデル座標系で行う
+    Mat4f model_local = matrix * node.matrix;
+    Mat3f normal      = model_local.block(0, 0, 3, 3);
+
+    nodeDraw(node,
+             model_view * node.matrix, normal,
+             shader_color, shader_texture,
+             lighting, lod,
+             model.mesh(), model.material(), model.materialOverride());
+    ++i;
+  }
 
-  popMatrix();
+  // 割り当てを解除しておく
+  gl_state.arrayBuffer(0);
+  gl_state.elementArrayBuffer(0);
 }
 
 
 // ノードに含まれるメッシュを描画
-// ノードの親子関係から再帰的に呼ばれる
 // シェーダー１つVer.
-void nodeDraw(Node& node,
-              const Mat4f& matrix,
+void nodeDraw(const NodeList::Body& node,
+              const Mat4f& model, const Mat3f& normal,
               const EasyShader& shader,
-              const bool lighting,
+              const bool lighting, const u_int lod,
               const std::deque<std::shared_ptr<Mesh> >& mesh,
-              const std::deque<Material>& material) {
-  // ノードが非表示な場合は子ノードもまとめて表示しない
-  if (!node.display()) return;
-  
-  pushMatrix();
-  multMatrix(node.matrix());
-  Mat4f model_local = matrix * node.matrix();
-
-  {
-    Mat4f& model = getModelMatrix();
-
-    // 光源はモデル座標系で行う
-    Mat3f normal = model_local.block(0, 0, 3, 3);
-
-    shader();
-    setupModelingMatrix(shader, model, normal, lighting);
-  }
-
+              const std::deque<Material>& material,
+              const MaterialOverride& material_override) {
   // ノードに含まれるメッシュを順番に描画
-  for (const u_int mesh_index : node.meshIndexes()) {
+  for (const u_int mesh_index : node.mesh_indexes) {
     const Mesh&     l_mesh     = *mesh[mesh_index];
     const Material& l_material = material[l_mesh.materialIndex()];
 
+    setupModelingMatrix(shader, model * l_mesh.positionMatrix(), normal, lighting);
     bool use_texture = l_material.texture();
-    setupShader(shader, l_material, use_texture, lighting);
-    meshDraw(l_mesh, shader, use_texture, lighting);
+    setupShader(shader, l_material, material_override, use_texture, lighting);
+    meshDraw(l_mesh, shader, use_texture, lighting, lod);
 
 #if 0
     if (use_texture) {
-      glBindTexture(GL_TEXTURE_2D, 0);
+      gl_state.texture(0);
     }
 #endif
   }
-    
-  // 子ノードを再帰的に描画
-  for (auto& child : node.childs()) {
-    nodeDraw(child,
-             model_local,
-             shader,
-             lighting,
-             mesh, material);
-  }
-  
-  popMatrix();
 }
 
 
@@ -263,18 +246,46 @@ void modelDraw(Model& model,
                const Mat4f& matrix,
                const EasyShader& shader,
                const bool lighting = false) {
-  pushMatrix();
-  multMatrix(matrix);
-
   shader();
+
+  // 書き換えがあった時だけ階層の行列を計算し直す
+  const NodeList& node_list = model.updatedNodes();
+
+  // カメラ行列との積は全ノード共通
+  Mat4f model_view = getModelMatrix() * matrix;
   
-  nodeDraw(model.rootNode(),
-           matrix,
-           shader,
-           lighting,
-           model.mesh(), model.material());
+  // 画面上の大きさでLODを選ぶ
+  const u_int lod = model.selectLod(model_view, getProjectionMatrix());
+
+  // 頂点バッファはモデル内の全メッシュで共通
+  const MeshBuffer& buffer = model.meshBuffer();
+  gl_state.arrayBuffer(buffer.vertexVbo());
+  gl_state.elementArrayBuffer(buffer.indexVbo());
+
+  const auto& nodes = node_list.nodes();
+  for (u_int i = 0; i < nodes.size(); ) {
+    const auto& node = nodes[i];
+    // ノードが非表示な場合は子ノードもまとめて表示しない
+    if (!node.display) {
+      i = node.end;
+      continue;
+    }
 
-  popMatrix();
+    // 光源はモデル座標系で行う
+    Mat4f model_local = matrix * node.matrix;
+    Mat3f normal      = model_local.block(0, 0, 3, 3);
+
+    nodeDraw(node,
+             model_view * node.matrix, normal,
+             shader,
+             lighting, lod,
+             model.mesh(), model.material(), model.materialOverride());
+    ++i;
+  }
+
+  // 割り当てを解除しておく
+  gl_state.arrayBuffer(0);
+  gl_state.elementArrayBuffer(0);
 }
 
 }
@@ -8,6 +8,8 @@
 
 #include <deque>
 #include <vector>
+#include <algorithm>
+#include <string>
 #include <assimp/scene.h>
 #include "co_vector.hpp"
 
@@ -98,4 +100,104 @@ public:
 
 };
 
+
+// 階層構造を親→子の順に並べた配列
+// モデル座標系での行列をキャッシュし、変更があった時だけ一度の走査で計算し直す
+class NodeList {
+public:
+  struct Body {
+    std::string name;
+    // 親の位置(ルートは-1)
+    int parent;
+    // 子孫を含めた範囲の末尾の次の位置
+    u_int end;
+    
+    Mat4f local_matrix;
+    // モデル座標系での行列
+    Mat4f matrix;
+
+    std::deque<u_int> mesh_indexes;
+    bool display;
+  };
+
+  
+private:
+  std::vector<Body> nodes_;
+  // 行列の再計算が必要な先頭の位置
+  u_int dirty_begin_;
+
+
+  void create(const Node& node, const int parent) {
+    u_int index = static_cast<u_int>(nodes_.size());
+    
+    Body body = {
+      node.name(),
+      parent,
+      0,
+      node.matrix(),
+      node.matrix(),
+      node.meshIndexes(),
+      node.display()
+    };
+    nodes_.push_back(body);
+
+    for (const auto& child : node.childs()) {
+      create(child, static_cast<int>(index));
+    }
+    nodes_[index].end = static_cast<u_int>(nodes_.size());
+  }
+
+  
+public:
+  NodeList() :
+    dirty_begin_(0)
+  {}
+
+  explicit NodeList(const Node& root) :
+    dirty_begin_(0)
+  {
+    nodes_.reserve(root.numNode());
+    create(root, -1);
+    update();
+  }
+
+  
+  const std::vector<Body>& nodes() const { return nodes_; }
+  size_t size() const { return nodes_.size(); }
+  
+  // 名前から位置を検索(見つからなければsize()を返す)
+  u_int find(const std::string& name) const {
+    u_int index = 0;
+    for (const auto& node : nodes_) {
+      if (node.name == name) break;
+      ++index;
+    }
+    return index;
+  }
+  
+  // ローカル行列を書き換えて、再計算が必要な事を記録
+  void localMatrix(const u_int index, const Mat4f& matrix) {
+    nodes_[index].local_matrix = matrix;
+    dirty_begin_ = std::min(dirty_begin_, index);
+  }
+  
+  void display(const u_int index, const bool display) {
+    nodes_[index].display = display;
+  }
+  
+  // 書き換えがあった位置以降の行列を計算し直す
+  // TIPS:親は必ず子より前にあるので、先頭から順に計算すればよい
+  void update() {
+    for (u_int i = dirty_begin_; i < nodes_.size(); ++i) {
+      Body& node = nodes_[i];
+      node.matrix = (node.parent < 0) ? node.local_matrix
+                                      : Mat4f(nodes_[node.parent].matrix * node.local_matrix);
+    }
+    dirty_begin_ = static_cast<u_int>(nodes_.size());
+  }
+
+  bool isDirty() const { return dirty_begin_ < nodes_.size(); }
+  
+};
+
 }
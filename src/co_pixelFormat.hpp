@@ -0,0 +1,249 @@
+﻿
+#pragma once
+
+//
+// テクスチャの画素形式の変換
+// 8bit/chの画像を16bitや輝度のみの形式に落としてメモリと帯域を減らす
+//
+
+#include "co_defines.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+
+namespace ngs {
+
+class PixelFormat {
+public:
+  enum Kind {
+    // 誤差を調べて自動で決める
+    AUTO,
+    RGB888,
+    RGBA8888,
+    RGB565,
+    RGBA4444,
+    LUMINANCE,
+    LUMINANCE_ALPHA,
+  };
+
+  // 自動判定で許容する誤差(0〜255)
+  // TIPS:16bit形式は量子化の誤差が最大でも8なので、最大値の制限は輝度形式にだけ効く
+  enum {
+    AUTO_RMS_LIMIT = 3,
+    AUTO_MAX_LIMIT = 8,
+  };
+  
+  // 変換結果
+  struct Image {
+    Kind kind;
+    GLenum format;
+    GLenum type;
+    std::vector<u_char> pixels;
+    // 元画像との誤差(0〜255)
+    float rms_error;
+    int max_error;
+  };
+
+  
+private:
+  // 誤差の集計
+  struct Error {
+    double sum;
+    int max;
+
+    Error() :
+      sum(0.0),
+      max(0)
+    {}
+
+    void add(const int src, const int dst) {
+      int e = std::abs(src - dst);
+      sum += e * e;
+      max = std::max(max, e);
+    }
+  };
+  
+  static int quantize(const int value, const int bits) {
+    const int max_value = (1 << bits) - 1;
+    return (value * max_value + 127) / 255;
+  }
+
+  static int expand(const int value, const int bits) {
+    const int max_value = (1 << bits) - 1;
+    return (value * 255 + max_value / 2) / max_value;
+  }
+
+  // RGBの3成分が全て等しい
+  static bool isGray(const u_char* image, const u_int num, const u_int pixel) {
+    for (u_int i = 0; i < num; ++i, image += pixel) {
+      if ((image[0] != image[1]) || (image[0] != image[2])) return false;
+    }
+    return true;
+  }
+
+  static void store16(std::vector<u_char>& pixels, const u_int index, const u_int value) {
+    // TIPS:GL_UNSIGNED_SHORT_*はネイティブのエンディアンで読まれる
+    GLushort v = static_cast<GLushort>(value);
+    u_char* dst = &pixels[index * 2];
+    std::copy(reinterpret_cast<const u_char*>(&v), reinterpret_cast<const u_char*>(&v) + 2, dst);
+  }
+
+  
+public:
+  // src_format: GL_RGB or GL_RGBA
+  static Image convert(const u_char* image, const u_int width, const u_int height,
+                       const GLenum src_format, Kind kind) {
+    const u_int num   = width * height;
+    const u_int pixel = (src_format == GL_RGB) ? 3 : 4;
+
+    if (kind == AUTO) kind = choose(image, width, height, src_format);
+
+    Image result;
+    result.kind = kind;
+
+    Error error;
+    // 1画素あたりの成分数
+    u_int channel = 1;
+    
+    switch (kind) {
+    case RGB565:
+      result.format = GL_RGB;
+      result.type   = GL_UNSIGNED_SHORT_5_6_5;
+      result.pixels.resize(num * 2);
+      for (u_int i = 0; i < num; ++i) {
+        const u_char* p = image + i * pixel;
+        int r = quantize(p[0], 5);
+        int g = quantize(p[1], 6);
+        int b = quantize(p[2], 5);
+        store16(result.pixels, i, (r << 11) | (g << 5) | b);
+        error.add(p[0], expand(r, 5));
+        error.add(p[1], expand(g, 6));
+        error.add(p[2], expand(b, 5));
+      }
+      channel = 3;
+      break;
+
+    case RGBA4444:
+      result.format = GL_RGBA;
+      result.type   = GL_UNSIGNED_SHORT_4_4_4_4;
+      result.pixels.resize(num * 2);
+      for (u_int i = 0; i < num; ++i) {
+        const u_char* p = image + i * pixel;
+        int c[4];
+        for (u_int j = 0; j < 4; ++j) {
+          // TIPS:RGBの画像はアルファを1.0として扱う
+          int value = (j < pixel) ? p[j] : 255;
+          c[j] = quantize(value, 4);
+          error.add(value, expand(c[j], 4));
+        }
+        store16(result.pixels, i, (c[0] << 12) | (c[1] << 8) | (c[2] << 4) | c[3]);
+      }
+      channel = 4;
+      break;
+
+    case LUMINANCE:
+    case LUMINANCE_ALPHA:
+      {
+        const u_int dst_pixel = (kind == LUMINANCE) ? 1 : 2;
+        result.format = (kind == LUMINANCE) ? GL_LUMINANCE : GL_LUMINANCE_ALPHA;
+        result.type   = GL_UNSIGNED_BYTE;
+        result.pixels.resize(num * dst_pixel);
+        for (u_int i = 0; i < num; ++i) {
+          const u_char* p = image + i * pixel;
+          // 重み付きの輝度
+          int l = (p[0] * 77 + p[1] * 150 + p[2] * 29 + 128) >> 8;
+          result.pixels[i * dst_pixel] = static_cast<u_char>(l);
+          if (dst_pixel == 2) result.pixels[i * dst_pixel + 1] = (pixel == 4) ? p[3] : 255;
+          error.add(p[0], l);
+          error.add(p[1], l);
+          error.add(p[2], l);
+        }
+        channel = 3;
+      }
+      break;
+
+    default:
+      // 8bit/chのまま
+      result.kind   = (pixel == 3) ? RGB888 : RGBA8888;
+      result.format = src_format;
+      result.type   = GL_UNSIGNED_BYTE;
+      result.pixels.assign(image, image + num * pixel);
+      break;
+    }
+
+    result.rms_error = static_cast<float>(std::sqrt(error.sum / (num * channel)));
+    result.max_error = error.max;
+    return result;
+  }
+
+  // 誤差が許容範囲に収まる一番小さい形式を選ぶ
+  // 灰色に近い画像は輝度形式を優先する(RGBAでは同じ2バイトでも、アルファが8bitのまま残る)
+  static Kind choose(const u_char* image, const u_int width, const u_int height, const GLenum src_format) {
+    const u_int pixel = (src_format == GL_RGB) ? 3 : 4;
+    const Kind luminance = (pixel == 3) ? LUMINANCE : LUMINANCE_ALPHA;
+    if (isGray(image, width * height, pixel)) return luminance;
+
+    const Image image_l = convert(image, width, height, src_format, luminance);
+    if ((image_l.rms_error <= AUTO_RMS_LIMIT) && (image_l.max_error <= AUTO_MAX_LIMIT)) {
+      return luminance;
+    }
+
+    const Kind candidate = (pixel == 3) ? RGB565 : RGBA4444;
+    const Image image_16 = convert(image, width, height, src_format, candidate);
+    if ((image_16.rms_error <= AUTO_RMS_LIMIT) && (image_16.max_error <= AUTO_MAX_LIMIT)) {
+      return candidate;
+    }
+    return (pixel == 3) ? RGB888 : RGBA8888;
+  }
+
+  // 1画素のバイト数
+  static u_int bytes(const Kind kind) {
+    switch (kind) {
+    case RGB888:          return 3;
+    case RGBA8888:        return 4;
+    case LUMINANCE:       return 1;
+    default:              return 2;
+    }
+  }
+
+  static const char* name(const Kind kind) {
+    static const char* tbl[] = {
+      "AUTO",
+      "RGB888",
+      "RGBA8888",
+      "RGB565",
+      "RGBA4444",
+      "LUMINANCE",
+      "LUMINANCE_ALPHA",
+    };
+    return tbl[kind];
+  }
+
+  // 変換結果を報告(Debug版のみ)
+#ifdef _DEBUG
+  static void report(const std::string& name, const u_int width, const u_int height,
+                     const GLenum src_format, const Image& image) {
+    // これまでの合計
+    static size_t total_src = 0;
+    static size_t total_dst = 0;
+
+    size_t src = width * height * ((src_format == GL_RGB) ? 3 : 4);
+    size_t dst = image.pixels.size();
+    total_src += src;
+    total_dst += dst;
+
+    DOUT << "Texture format:" << name << " " << PixelFormat::name(image.kind)
+         << " " << src << "->" << dst << " bytes"
+         << " rms:" << image.rms_error << " max:" << image.max_error
+         << " (total " << total_src << "->" << total_dst << ")" << std::endl;
+  }
+#else
+  static void report(const std::string&, const u_int, const u_int, const GLenum, const Image&) {}
+#endif
+};
+
+}
@@ -0,0 +1,311 @@
+﻿
+#pragma once
+
+//
+// 処理時間の計測
+// 区間ごとのCPU時間と、使えればGPU時間を記録する
+// TIPS:GPU時間は数フレーム遅れて結果を取り出す(待たせない為)
+//
+
+#include "co_defines.hpp"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <boost/noncopyable.hpp>
+#include "co_time.hpp"
+
+
+namespace ngs {
+
+class Profiler : private boost::noncopyable {
+public:
+  enum {
+    // 記録しておくフレーム数
+    HISTORY = 64,
+    // 区間の最大数
+    SECTION_MAX = 16,
+    // GPU時間を取り出すまでのフレーム数
+    QUERY_LATENCY = 4
+  };
+
+  struct Section {
+    std::string name;
+    // 他の区間の内側で計測している
+    bool nested;
+    // ミリ秒(GPU時間が取れない場合は負)
+    float cpu[HISTORY];
+    float gpu[HISTORY];
+  };
+
+  // 区間の開始と終了を自動で行う
+  class Scope : private boost::noncopyable {
+    Profiler& profiler_;
+
+  public:
+    Scope(Profiler& profiler, const char* name, const bool gpu = false) :
+      profiler_(profiler)
+    {
+      profiler_.begin(name, gpu);
+    }
+
+    ~Scope() {
+      profiler_.end();
+    }
+  };
+
+  
+private:
+  struct Running {
+    u_int section;
+    double start;
+    bool gpu;
+  };
+  
+  bool active_;
+  std::vector<Section> sections_;
+  std::vector<Running> stack_;
+
+  // 現在のフレーム
+  u_int frame_;
+  double frame_start_;
+  // フレーム全体の時間(ミリ秒)
+  float frame_time_[HISTORY];
+
+  std::ofstream csv_;
+  u_int csv_columns_;
+  
+#if defined (USE_GPU_TIMER)
+  bool gpu_timer_;
+  // [フレーム][区間][開始, 終了]
+  GLuint queries_[QUERY_LATENCY][SECTION_MAX][2];
+  bool issued_[QUERY_LATENCY][SECTION_MAX];
+#endif
+
+  
+public:
+  Profiler() :
+    active_(false),
+    frame_(0),
+    frame_start_(0.0),
+    csv_columns_(0)
+#if defined (USE_GPU_TIMER)
+    , gpu_timer_(false)
+#endif
+  {
+    DOUT << "Profiler()" << std::endl;
+    
+    for (u_int i = 0; i < HISTORY; ++i) frame_time_[i] = 0.0f;
+  }
+
+  ~Profiler() {
+    DOUT << "~Profiler()" << std::endl;
+    
+#if defined (USE_GPU_TIMER)
+    if (gpu_timer_) glDeleteQueries(QUERY_LATENCY * SECTION_MAX * 2, &queries_[0][0][0]);
+#endif
+  }
+
+
+  bool active() const { return active_; }
+  
+  // 計測の開始/停止
+  // TIPS:OpenGLのコンテキストが準備できてから呼ぶ
+  void active(const bool active) {
+    active_ = active;
+    stack_.clear();
+    frame_start_ = glfwGetTime();
+
+#if defined (USE_GPU_TIMER)
+    if (active_ && !gpu_timer_ && GLEW_ARB_timer_query) {
+      glGenQueries(QUERY_LATENCY * SECTION_MAX * 2, &queries_[0][0][0]);
+      for (u_int i = 0; i < QUERY_LATENCY; ++i) {
+        for (u_int j = 0; j < SECTION_MAX; ++j) issued_[i][j] = false;
+      }
+      gpu_timer_ = true;
+    }
+#endif
+  }
+
+  bool gpuTimer() const {
+#if defined (USE_GPU_TIMER)
+    return gpu_timer_;
+#else
+    return false;
+#endif
+  }
+  
+  // フレームの区切り
+  void frame() {
+    if (!active_) return;
+
+    const double now = glfwGetTime();
+    frame_time_[frame_ % HISTORY] = float((now - frame_start_) * 1000.0);
+    frame_start_ = now;
+
+    // GPU時間が揃ったフレームを確定させる
+    const u_int finished = frame_ + 1 - QUERY_LATENCY;
+    if (frame_ + 1 >= QUERY_LATENCY) {
+      collectGpu(finished);
+      writeCsv(finished);
+    }
+
+    frame_ += 1;
+    const u_int index = frame_ % HISTORY;
+    frame_time_[index] = 0.0f;
+    for (auto& section : sections_) {
+      section.cpu[index] = 0.0f;
+      section.gpu[index] = -1.0f;
+    }
+  }
+
+  void begin(const char* name, const bool gpu = false) {
+    if (!active_) return;
+
+    Running running = { findSection(name), glfwGetTime(), gpu };
+    if (running.section >= SECTION_MAX) return;
+    sections_[running.section].nested = !stack_.empty();
+    stack_.push_back(running);
+
+#if defined (USE_GPU_TIMER)
+    if (gpu_timer_ && gpu) {
+      glQueryCounter(queries_[frame_ % QUERY_LATENCY][running.section][0], GL_TIMESTAMP);
+    }
+#endif
+  }
+
+  void end() {
+    if (!active_ || stack_.empty()) return;
+
+    const Running& running = stack_.back();
+    Section& section = sections_[running.section];
+    section.cpu[frame_ % HISTORY] += float((glfwGetTime() - running.start) * 1000.0);
+
+#if defined (USE_GPU_TIMER)
+    if (gpu_timer_ && running.gpu) {
+      const u_int slot = frame_ % QUERY_LATENCY;
+      glQueryCounter(queries_[slot][running.section][1], GL_TIMESTAMP);
+      issued_[slot][running.section] = true;
+    }
+#endif
+    stack_.pop_back();
+  }
+
+  const std::vector<Section>& sections() const { return sections_; }
+  // 確定した最新のフレーム
+  u_int latestFrame() const { return (frame_ >= QUERY_LATENCY) ? (frame_ - QUERY_LATENCY) : 0; }
+  float frameTime(const u_int frame) const { return frame_time_[frame % HISTORY]; }
+
+  // 過去のフレームの平均(ミリ秒)
+  float averageCpu(const Section& section) const { return average(section.cpu); }
+  float averageGpu(const Section& section) const { return average(section.gpu); }
+  float averageFrame() const { return average(frame_time_); }
+
+  // 確定したフレームのGPU時間の合計(ミリ秒)
+  // TIPS:入れ子の区間は外側に含まれるので数えない。取れなかった場合は負
+  float gpuFrameTime(const u_int frame) const {
+    float total = -1.0f;
+    for (const auto& section : sections_) {
+      const float gpu = section.gpu[frame % HISTORY];
+      if (section.nested || (gpu < 0.0f)) continue;
+      total = std::max(total, 0.0f) + gpu;
+    }
+    return total;
+  }
+
+  
+  // フレームごとの時間をCSVへ書き出す
+  // 空のパスで書き出しを止める
+  void csv(const std::string& path) {
+    if (csv_.is_open()) csv_.close();
+    csv_columns_ = 0;
+    if (path.empty()) return;
+
+    csv_.open(path);
+    DOUT << "Profiler csv:" << path << std::endl;
+  }
+
+  bool csv() const { return csv_.is_open(); }
+
+  
+private:
+  u_int findSection(const char* name) {
+    for (u_int i = 0; i < sections_.size(); ++i) {
+      if (sections_[i].name == name) return i;
+    }
+    if (sections_.size() >= SECTION_MAX) return SECTION_MAX;
+
+    Section section;
+    section.name   = name;
+    section.nested = false;
+    for (u_int i = 0; i < HISTORY; ++i) {
+      section.cpu[i] = 0.0f;
+      section.gpu[i] = -1.0f;
+    }
+    sections_.push_back(section);
+    return static_cast<u_int>(sections_.size() - 1);
+  }
+
+  // 値が取れているフレームだけで平均を取る
+  // TIPS:計測中のフレームは除く
+  float average(const float* values) const {
+    float total = 0.0f;
+    u_int num   = 0;
+    for (u_int i = 0; i < HISTORY; ++i) {
+      if ((i == (frame_ % HISTORY)) || (values[i] < 0.0f)) continue;
+      total += values[i];
+      num += 1;
+    }
+    return num ? (total / num) : -1.0f;
+  }
+
+  void collectGpu(const u_int frame) {
+#if defined (USE_GPU_TIMER)
+    if (!gpu_timer_) return;
+
+    const u_int slot = frame % QUERY_LATENCY;
+    for (u_int i = 0; i < sections_.size(); ++i) {
+      if (!issued_[slot][i]) continue;
+      issued_[slot][i] = false;
+
+      // TIPS:まだ結果が出ていなければ諦める(待つと計測自体が遅延の原因になる)
+      GLint available = 0;
+      glGetQueryObjectiv(queries_[slot][i][1], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) continue;
+      
+      GLuint64 start;
+      GLuint64 end;
+      glGetQueryObjectui64v(queries_[slot][i][0], GL_QUERY_RESULT, &start);
+      glGetQueryObjectui64v(queries_[slot][i][1], GL_QUERY_RESULT, &end);
+      sections_[i].gpu[frame % HISTORY] = float((end - start) / 1000000.0);
+    }
+#else
+    (void)frame;
+#endif
+  }
+  
+  void writeCsv(const u_int frame) {
+    if (!csv_.is_open()) return;
+
+    const u_int index = frame % HISTORY;
+    if (!csv_columns_) {
+      // TIPS:最初に書き出す時点で分かっている区間だけを列にする
+      csv_columns_ = static_cast<u_int>(sections_.size());
+      csv_ << "frame,frame_ms";
+      for (u_int i = 0; i < csv_columns_; ++i) {
+        csv_ << "," << sections_[i].name << "_cpu," << sections_[i].name << "_gpu";
+      }
+      csv_ << "\n";
+    }
+
+    csv_ << frame << "," << frame_time_[index];
+    for (u_int i = 0; i < csv_columns_; ++i) {
+      csv_ << "," << sections_[i].cpu[index] << ",";
+      if (sections_[i].gpu[index] >= 0.0f) csv_ << sections_[i].gpu[index];
+    }
+    csv_ << "\n";
+  }
+  
+};
+
+}
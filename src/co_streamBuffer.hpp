@@ -0,0 +1,84 @@
+﻿
+#pragma once
+
+//
+// 毎フレーム書き換える頂点データ用のリングバッファ
+//
+
+#include "co_defines.hpp"
+#include <cassert>
+#include <boost/noncopyable.hpp>
+#include "co_glState.hpp"
+
+
+namespace ngs {
+
+class StreamBuffer : private boost::noncopyable {
+  GLuint handle_;
+
+  GLsizeiptr size_;
+  GLsizeiptr offset_;
+
+
+  // TIPS:GLのコンテキストが出来てから生成する
+  void bind() {
+    if (handle_) {
+      gl_state.arrayBuffer(handle_);
+      return;
+    }
+    
+    glGenBuffers(1, &handle_);
+    gl_state.arrayBuffer(handle_);
+    glBufferData(GL_ARRAY_BUFFER, size_, 0, GL_STREAM_DRAW);
+    offset_ = 0;
+  }
+  
+
+public:
+  explicit StreamBuffer(const GLsizeiptr size) :
+    handle_(0),
+    size_(size),
+    offset_(0)
+  {
+    DOUT << "StreamBuffer()" << std::endl;
+  }
+
+  ~StreamBuffer() {
+    DOUT << "~StreamBuffer()" << std::endl;
+    if (handle_) gl_state.deleteBuffer(handle_);
+  }
+
+
+  GLuint handle() const { return handle_; }
+  
+  // データを書き込んで、バッファ先頭からのオフセットを返す
+  // TIPS:GL_ARRAY_BUFFERにバインドした状態で戻る
+  GLintptr write(const void* data, const GLsizeiptr size) {
+    assert(size <= size_);
+    bind();
+
+    // 4byte境界に揃える
+    GLsizeiptr aligned_size = (size + 3) & ~GLsizeiptr(3);
+    if ((offset_ + aligned_size) > size_) {
+      // 使い切ったら領域を確保し直して(orphaning)先頭から使う
+      // GPUが参照中の古い領域はドライバが解放するので、書き込みで待たされない
+      glBufferData(GL_ARRAY_BUFFER, size_, 0, GL_STREAM_DRAW);
+      offset_ = 0;
+    }
+
+    // ES 2.0にはglMapBufferRangeが無いのでglBufferSubDataで書き込む
+    glBufferSubData(GL_ARRAY_BUFFER, offset_, size, data);
+
+    GLintptr offset = offset_;
+    offset_ += aligned_size;
+    return offset;
+  }
+
+  // オフセットをglVertexAttribPointerへ渡す形式に変換
+  static const GLvoid* pointer(const GLintptr offset) {
+    return reinterpret_cast<const GLvoid*>(offset);
+  }
+  
+};
+
+}
@@ -0,0 +1,224 @@
+﻿
+#pragma once
+
+//
+// 展開済みテクスチャ(.tex)
+// PNGを展開してミップマップまで作っておき、実行時はメモリに割り当ててそのまま転送する
+//
+// 構成: Header, 各レベルの[u_int サイズ, 画像(4バイト境界に揃える)]
+// TIPS:元のPNGのハッシュ値を持っていて、PNGが更新されていたら使わない
+//
+
+#include "co_defines.hpp"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <cassert>
+#include <boost/noncopyable.hpp>
+#include "co_mappedFile.hpp"
+#include "co_fileUtil.hpp"
+#include "co_misc.hpp"
+#include "co_pixelFormat.hpp"
+
+
+namespace ngs {
+
+class TexFile : private boost::noncopyable {
+public:
+	enum {
+		VERSION = 2,
+		LEVEL_MAX = 16,
+	};
+
+	struct Header {
+		char  magic[4];
+		u_int version;
+		u_int width;
+		u_int height;
+		// glTexImage2Dに渡す値
+		u_int format;
+		u_int type;
+		u_int levels;
+		// 元画像のファイルのハッシュ値(sourceHash)
+		u_int source;
+	};
+
+private:
+	MappedFile file_;
+	const Header* header_;
+	const u_char* images_[LEVEL_MAX];
+	u_int sizes_[LEVEL_MAX];
+
+	static u_int align(const u_int size) { return (size + 3) & ~3; }
+
+	static u_int pixelSize(const u_int format) {
+		return (format == GL_RGB) ? 3 : 4;
+	}
+
+	// 転送する時の1画素のバイト数
+	static u_int bytesPerPixel(const u_int format, const u_int type) {
+		if ((type == GL_UNSIGNED_SHORT_5_6_5) || (type == GL_UNSIGNED_SHORT_4_4_4_4)) return 2;
+
+		switch (format) {
+		case GL_LUMINANCE:       return 1;
+		case GL_LUMINANCE_ALPHA: return 2;
+		case GL_RGB:             return 3;
+		default:                 return 4;
+		}
+	}
+
+	// 2x2の平均で縮小
+	static std::vector<u_char> shrink(const std::vector<u_char>& image,
+																		const u_int width, const u_int height, const u_int pixel) {
+		const u_int w = std::max(width / 2, 1u);
+		const u_int h = std::max(height / 2, 1u);
+		std::vector<u_char> result(w * h * pixel);
+
+		for (u_int y = 0; y < h; ++y) {
+			const u_int y0 = std::min(y * 2, height - 1);
+			const u_int y1 = std::min(y * 2 + 1, height - 1);
+			for (u_int x = 0; x < w; ++x) {
+				const u_int x0 = std::min(x * 2, width - 1);
+				const u_int x1 = std::min(x * 2 + 1, width - 1);
+				for (u_int c = 0; c < pixel; ++c) {
+					u_int sum = image[(y0 * width + x0) * pixel + c] + image[(y0 * width + x1) * pixel + c]
+										+ image[(y1 * width + x0) * pixel + c] + image[(y1 * width + x1) * pixel + c];
+					result[(y * w + x) * pixel + c] = static_cast<u_char>((sum + 2) / 4);
+				}
+			}
+		}
+		return result;
+	}
+
+public:
+	// source: 元画像のハッシュ値。一致しなければ使えない
+	TexFile(const std::string& path, const u_int source) :
+		file_(path),
+		header_(),
+		images_(),
+		sizes_()
+	{
+		DOUT << "TexFile()" << std::endl;
+		if (!file_.valid() || (file_.size() < sizeof(Header))) return;
+
+		const Header* header = reinterpret_cast<const Header*>(file_.data());
+		if (std::memcmp(header->magic, "NGTX", 4) || (header->version != VERSION)
+				|| (header->source != source)
+				|| (header->width == 0) || (header->height == 0)
+				|| (header->levels == 0) || (header->levels > LEVEL_MAX)) {
+			DOUT << "TexFile format error:" << path << std::endl;
+			return;
+		}
+
+		// 各レベルの位置を調べる
+		// TIPS:ヘッダの大きさに足りない画像はglTexImage2Dが範囲外を読むので使わない
+		const u_int pixel = bytesPerPixel(header->format, header->type);
+		size_t offset = sizeof(Header);
+		for (u_int i = 0; i < header->levels; ++i) {
+			if ((offset + sizeof(u_int)) > file_.size()) return;
+			u_int size;
+			std::memcpy(&size, file_.data() + offset, sizeof(size));
+			offset += sizeof(u_int);
+
+			const size_t w = std::max(header->width >> i, 1u);
+			const size_t h = std::max(header->height >> i, 1u);
+			if (size < (w * h * pixel)) {
+				DOUT << "TexFile size error:" << path << " level:" << i << std::endl;
+				return;
+			}
+			if ((offset + size) > file_.size()) return;
+			images_[i] = file_.data() + offset;
+			sizes_[i]  = size;
+			offset += align(size);
+		}
+		header_ = header;
+	}
+
+	bool valid() const { return header_ != 0; }
+
+	u_int width() const { return header_->width; }
+	u_int height() const { return header_->height; }
+	u_int format() const { return header_->format; }
+	u_int type() const { return header_->type; }
+	u_int levels() const { return header_->levels; }
+
+	const u_char* image(const u_int level) const { return images_[level]; }
+	u_int size(const u_int level) const { return sizes_[level]; }
+
+
+	// 画像ファイルと同じ場所に置く
+	static std::string path(const std::string& image_path) {
+		return changeFileExt(image_path, ".tex");
+	}
+
+	// 元画像のファイルの中身から求めたハッシュ値
+	// TIPS:複数の画像から作る場合(アトラス)は全部をまとめる
+	static u_int sourceHash(const std::vector<std::string>& paths) {
+		u_int hash = hashBytes(0, 0);
+		for (const auto& path : paths) {
+			MappedFile file(path);
+			const u_int size = static_cast<u_int>(file.size());
+			hash = hashBytes(&size, sizeof(size), hash);
+			if (file.valid()) hash = hashBytes(file.data(), file.size(), hash);
+		}
+		return hash;
+	}
+
+	static u_int sourceHash(const std::string& path) {
+		return sourceHash(std::vector<std::string>(1, path));
+	}
+
+	// 展開済みの画像を書き出す
+	// format: GL_RGB or GL_RGBA
+	// mipmap: trueならミップマップも作る
+	// kind:   書き出す画素形式(ミップマップは8bitで縮小してから変換する)
+	// source: 元画像のハッシュ値(sourceHash)
+	static void write(const std::string& path, const u_int source, const u_int width, const u_int height,
+										const u_int format, const u_char* image, const bool mipmap,
+										const PixelFormat::Kind kind = PixelFormat::AUTO) {
+		std::ofstream fs(path, std::ios::binary);
+		if (!fs) return;
+
+		const u_int pixel = pixelSize(format);
+		std::vector<std::vector<u_char> > levels;
+		levels.push_back(std::vector<u_char>(image, image + width * height * pixel));
+
+		u_int w = width;
+		u_int h = height;
+		while (mipmap && ((w > 1) || (h > 1)) && (levels.size() < LEVEL_MAX)) {
+			levels.push_back(shrink(levels.back(), w, h, pixel));
+			w = std::max(w / 2, 1u);
+			h = std::max(h / 2, 1u);
+		}
+
+		// 最初のレベルで形式を決めて、以降はそれに揃える
+		const PixelFormat::Image top = PixelFormat::convert(&levels[0][0], width, height, format, kind);
+
+		Header header;
+		std::memcpy(header.magic, "NGTX", 4);
+		header.version = VERSION;
+		header.width   = width;
+		header.height  = height;
+		header.format  = top.format;
+		header.type    = top.type;
+		header.levels  = static_cast<u_int>(levels.size());
+		header.source  = source;
+		fs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		static const char padding[4] = {};
+		for (u_int i = 0; i < levels.size(); ++i) {
+			const u_int w = std::max(width >> i, 1u);
+			const u_int h = std::max(height >> i, 1u);
+			const std::vector<u_char> pixels = PixelFormat::convert(&levels[i][0], w, h, format, top.kind).pixels;
+			u_int size = static_cast<u_int>(pixels.size());
+			fs.write(reinterpret_cast<const char*>(&size), sizeof(size));
+			fs.write(reinterpret_cast<const char*>(&pixels[0]), size);
+			fs.write(padding, align(size) - size);
+		}
+		DOUT << "TexFile write:" << path << " levels:" << levels.size() << std::endl;
+	}
+};
+
+}
@@ -9,6 +9,9 @@
 #include <string>
 #include <unordered_map>
 #include <memory>
+#include <vector>
+#include <cmath>
+#include <cstring>
 #include "co_texture.hpp"
 #include "co_fileUtil.hpp"
 
@@ -21,6 +24,46 @@ public:
 
 private:
 	std::unordered_map<std::string, TexPtr> tex_obj_;
+
+
+	// PNGを読み込んでアトラスを作る
+	static TexPtr composeAtlas(const std::string& name, const std::vector<std::string>& paths,
+														 const int cols, const int rows, const std::string& tex_path) {
+		std::vector<std::shared_ptr<Png> > images;
+		for (const auto& path : paths) {
+			images.push_back(std::make_shared<Png>(path));
+		}
+
+		const int width  = images[0]->width();
+		const int height = images[0]->height();
+		const int type   = images[0]->type();
+		const int pixel  = (type == PNG_COLOR_TYPE_RGB) ? 3 : 4;
+		const int atlas_width  = width * cols;
+		const int atlas_height = height * rows;
+
+		std::vector<u_char> atlas_image(atlas_width * atlas_height * pixel);
+		const int num = static_cast<int>(images.size());
+		for (int i = 0; i < num; ++i) {
+			const Png& png = *images[i];
+			assert((png.width() == width) && (png.height() == height) && (png.type() == type));
+
+			const int x = (i % cols) * width;
+			const int y = (i / cols) * height;
+			for (int h = 0; h < height; ++h) {
+				std::memcpy(&atlas_image[((y + h) * atlas_width + x) * pixel], png.image() + h * width * pixel, width * pixel);
+			}
+		}
+
+		const GLint gl_type = (pixel == 3) ? GL_RGB : GL_RGBA;
+		TexPtr atlas(std::make_shared<Texture>(name, atlas_width, atlas_height, gl_type, &atlas_image[0]));
+#ifdef _DEBUG
+		// 展開済みのファイルを作り直す
+		TexFile::write(tex_path, TexFile::sourceHash(paths), atlas_width, atlas_height, gl_type, &atlas_image[0], false, atlas->format());
+#else
+		(void)tex_path;
+#endif
+		return atlas;
+	}
 		
 public:
 	TexMng() {
@@ -49,6 +92,48 @@ public:
     return obj;
 	}
 
+	// 同じ大きさと形式のPNGを1枚のテクスチャに並べて読み込む
+	// 以降read()やget()はファイル名でアトラス内の領域を返す
+	// 並べた結果は最初のPNGと同じ場所に展開済みファイル(<name>.tex)として書き出し、Release版はそちらを使う
+	// TIPS:領域は半テクセル内側に取り、隣の画像がにじまないようにしている
+	TexPtr readAtlas(const std::string& name, const std::vector<std::string>& paths) {
+		assert(!paths.empty());
+
+		// 縦横が2のべき乗になるように並べる
+		const int num  = static_cast<int>(paths.size());
+		const int cols = int2pow(static_cast<int>(std::ceil(std::sqrt(static_cast<float>(num)))));
+		const int rows = int2pow((num + cols - 1) / cols);
+
+		const std::string tex_path = paths[0].substr(0, paths[0].rfind('/') + 1) + name + ".tex";
+		TexPtr atlas;
+#if !defined (_DEBUG)
+		{
+			TexFile file(tex_path, TexFile::sourceHash(paths));
+			if (file.valid()) atlas = std::make_shared<Texture>(name, file);
+		}
+#endif
+		if (!atlas) atlas = composeAtlas(name, paths, cols, rows, tex_path);
+
+		const int atlas_width  = atlas->width();
+		const int atlas_height = atlas->height();
+		const int width  = atlas_width / cols;
+		const int height = atlas_height / rows;
+		DOUT << "Atlas:" << name << " " << atlas_width << " x " << atlas_height << std::endl;
+
+		for (int i = 0; i < num; ++i) {
+			const int x = (i % cols) * width;
+			const int y = (i / cols) * height;
+			Vec4f uv_rect((x + 0.5f) / atlas_width, (y + 0.5f) / atlas_height,
+			              (width - 1.0f) / atlas_width, (height - 1.0f) / atlas_height);
+
+			const std::string file_name = getFileName(paths[i]);
+			TexPtr obj(std::make_shared<Texture>(atlas, file_name, width, height, uv_rect));
+			tex_obj_.insert(std::unordered_map<std::string, TexPtr>::value_type(file_name, obj));
+		}
+
+		return atlas;
+	}
+
 	TexPtr get(const std::string& name) {
 		auto it = tex_obj_.find(name);
     if (it != tex_obj_.end()) {
@@ -6,10 +6,16 @@
 //
 
 #include <string>
+#include <memory>
+#include <algorithm>
 #include <boost/noncopyable.hpp>
 #include "co_png.hpp"
+#include "co_texFile.hpp"
+#include "co_pixelFormat.hpp"
 #include "co_fileUtil.hpp"
 #include "co_misc.hpp"
+#include "co_vector.hpp"
+#include "co_glState.hpp"
 
 
 namespace ngs {
@@ -20,6 +26,12 @@ class Texture : public boost::noncopyable {
   int height_;
 	std::string name_;
 	bool mipmap_;
+  // 転送する画素形式
+  PixelFormat::Kind format_;
+  // アトラスの一部の場合、アトラス全体のテクスチャ
+  std::shared_ptr<const Texture> atlas_;
+  // テクスチャ内の領域(x, y, 幅, 高さ)
+  Vec4f uv_rect_;
 
 
   // テクスチャの基本的なパラメーター設定を行う
@@ -41,51 +53,168 @@ class Texture : public boost::noncopyable {
       return;
     }
 
-		glBindTexture(GL_TEXTURE_2D, id_);
+		GLint type = (png_obj.type() == PNG_COLOR_TYPE_RGB) ? GL_RGB : GL_RGBA;
+    setupImage(type, png_obj.image(), mipmap);
+
+#ifdef _DEBUG
+    // 展開済みのファイルを作り直す
+    // TIPS:形式は自動判定の結果に揃える
+    TexFile::write(TexFile::path(filename), TexFile::sourceHash(filename), width_, height_, type, png_obj.image(), mipmap, format_);
+#endif
+		
+    DOUT << "Texture:" << name_ << ((type == GL_RGB) ? " RGB" : " RGBA") << std::endl;
+	}
+
+  // 展開済みのファイルから読み込む
+  // false: 使えるファイルが無い
+  bool setupTexFile(const std::string& filename, const bool mipmap) {
+    TexFile file(TexFile::path(filename), TexFile::sourceHash(filename));
+    return setupTexFile(file, mipmap);
+  }
+
+  bool setupTexFile(const TexFile& file, const bool mipmap) {
+    // TIPS:ミップマップが必要なのに含まれていなければPNGから作る
+    if (!file.valid() || (mipmap && (file.levels() == 1))) return false;
+
+    width_  = file.width();
+    height_ = file.height();
+    
+		gl_state.texture(id_);
 		setupTextureParam(mipmap);
 
-		GLint type = (png_obj.type() == PNG_COLOR_TYPE_RGB) ? GL_RGB : GL_RGBA;
+    // TIPS:小さいレベルは行が4バイト境界に揃わない
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    const u_int levels = mipmap ? file.levels() : 1;
+    for (u_int i = 0; i < levels; ++i) {
+      GLsizei w = std::max(width_ >> i, 1);
+      GLsizei h = std::max(height_ >> i, 1);
+      glTexImage2D(GL_TEXTURE_2D, i, file.format(), w, h, 0, file.format(), file.type(), file.image(i));
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    DOUT << "Texture:" << name_ << " tex levels:" << levels << std::endl;
+    return true;
+  }
+
+  // type: GL_RGB or GL_RGBA
+  void setupImage(const GLint type, const u_char* image, const bool mipmap) {
+    // 指定された形式に変換して転送
+    const PixelFormat::Image converted = PixelFormat::convert(image, width_, height_, type, format_);
+    PixelFormat::report(name_, width_, height_, type, converted);
+    format_ = converted.kind;
+
+    const GLenum format = converted.format;
+    const GLvoid* pixels = &converted.pixels[0];
+    
+		gl_state.texture(id_);
+		setupTextureParam(mipmap);
+
+    // TIPS:1画素1〜2バイトの形式は行が4バイト境界に揃わないことがある
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 #if defined (_MSC_VER)
-		if (mipmap) {
-			gluBuild2DMipmaps(GL_TEXTURE_2D, type, width_, height_, type, GL_UNSIGNED_BYTE, png_obj.image());
-			// FIXME:WindowsだとglGenerateMipmap()が使えない？
+		if (mipmap && !glGenerateMipmap) {
+      // TIPS:Windows標準のGLU(1.2)は16ビット形式を受け付けないので、8ビットの形式で作り直す
+      PixelFormat::Image full;
+      const PixelFormat::Image* source = &converted;
+      if (converted.type != GL_UNSIGNED_BYTE) {
+        full = PixelFormat::convert(image, width_, height_, type,
+                                    (type == GL_RGB) ? PixelFormat::RGB888 : PixelFormat::RGBA8888);
+        source = &full;
+        format_ = full.kind;
+      }
+			gluBuild2DMipmaps(GL_TEXTURE_2D, source->format, width_, height_, source->format, source->type, &source->pixels[0]);
 		}
 		else {
-			glTexImage2D(GL_TEXTURE_2D, 0, type, width_, height_, 0, type, GL_UNSIGNED_BYTE, png_obj.image());
+			glTexImage2D(GL_TEXTURE_2D, 0, format, width_, height_, 0, format, converted.type, pixels);
+      // TIPS:GLEW経由で使えるならこちら(16ビット形式もそのまま扱える)
+			if (mipmap) glGenerateMipmap(GL_TEXTURE_2D);
 		}
 #else
-		glTexImage2D(GL_TEXTURE_2D, 0, type, width_, height_, 0, type, GL_UNSIGNED_BYTE, png_obj.image());
+		glTexImage2D(GL_TEXTURE_2D, 0, format, width_, height_, 0, format, converted.type, pixels);
 		if (mipmap) glGenerateMipmap(GL_TEXTURE_2D);
 #endif
-		
-    DOUT << "Texture:" << name_ << ((type == PNG_COLOR_TYPE_RGB) ? " RGB" : " RGBA") << std::endl;
-	}
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
 	
 public:
-	Texture(const std::string& filename, const bool mipmap = false) :
+  // format: 転送する画素形式(AUTOは誤差を調べて決める)
+	Texture(const std::string& filename, const bool mipmap = false,
+          const PixelFormat::Kind format = PixelFormat::AUTO) :
 		name_(getFileName(filename)),
-		mipmap_(mipmap)
+		mipmap_(mipmap),
+    format_(format),
+    uv_rect_(0.0f, 0.0f, 1.0f, 1.0f)
 	{
     DOUT << "Texture()" << std::endl;
 		glGenTextures(1, &id_);
+#if !defined (_DEBUG)
+    if (setupTexFile(filename, mipmap)) return;
+#endif
     setupPng(filename, mipmap);
 	}
+
+  // メモリ上の画像から生成
+  // type: GL_RGB or GL_RGBA
+	Texture(const std::string& name, const int width, const int height, const GLint type, const u_char* image,
+          const PixelFormat::Kind format = PixelFormat::AUTO) :
+    width_(width),
+    height_(height),
+		name_(name),
+		mipmap_(false),
+    format_(format),
+    uv_rect_(0.0f, 0.0f, 1.0f, 1.0f)
+	{
+    DOUT << "Texture()" << std::endl;
+		glGenTextures(1, &id_);
+    setupImage(type, image, false);
+	}
+
+  // 展開済みのファイルから生成
+  // TIPS:file.valid()は呼び出し側で調べておく
+	Texture(const std::string& name, const TexFile& file) :
+		name_(name),
+		mipmap_(false),
+    format_(PixelFormat::AUTO),
+    uv_rect_(0.0f, 0.0f, 1.0f, 1.0f)
+	{
+    DOUT << "Texture()" << std::endl;
+		glGenTextures(1, &id_);
+    setupTexFile(file, false);
+	}
+
+  // アトラスの一部として生成
+	Texture(const std::shared_ptr<const Texture>& atlas, const std::string& name,
+          const int width, const int height, const Vec4f& uv_rect) :
+    id_(0),
+    width_(width),
+    height_(height),
+		name_(name),
+		mipmap_(false),
+    format_(atlas->format_),
+    atlas_(atlas),
+    uv_rect_(uv_rect)
+	{
+    DOUT << "Texture()" << std::endl;
+	}
 	
 	~Texture() {
     DOUT << "~Texture()" << std::endl;
-		glDeleteTextures(1, &id_);
+		if (id_) gl_state.deleteTexture(id_);
 	}
 
   int width() const { return width_; }
   int height() const { return height_; }
 	const std::string& name() const { return name_; }
+  const Vec4f& uvRect() const { return uv_rect_; }
+  bool inAtlas() const { return atlas_ ? true : false; }
+  PixelFormat::Kind format() const { return format_; }
 
 	void bind() const {
-		glBindTexture(GL_TEXTURE_2D, id_);
+		gl_state.texture(atlas_ ? atlas_->id_ : id_);
 	}
 
 	void unbind() const {
-		glBindTexture(GL_TEXTURE_2D, 0);
+		gl_state.texture(0);
 	}
   
 };
@@ -7,6 +7,7 @@
 
 #include "co_defines.hpp"
 #include "co_vector.hpp"
+#include "co_glState.hpp"
 
 
 namespace ngs {
@@ -78,6 +79,8 @@ public:
   }
 
   const Vec2f& size() const { return size_; }
+  // ビューポートの大きさ(ピクセル)
+  Vec2f viewportSize() const { return Vec2f(width_, height_); }
   float scale() const { return scale_; }
 
   void clearColor(const GrpCol& color) { clear_color_ = color; }
@@ -100,7 +103,7 @@ public:
   }
 
   void setupViewport() const {
-    glViewport(0, 0, width_, height_);
+    gl_state.viewport(0, 0, width_, height_);
   }
 
 
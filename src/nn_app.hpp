@@ -56,6 +56,9 @@ public:
   void update() {
     if (proc_paused_) return;
 
+    // 処理時間の計測はここでフレームを区切る
+    profiler().frame();
+
     // 起動直後は実行時間一定で更新する
     if (stability_fame_ > 0) --stability_fame_;
     
@@ -101,7 +104,15 @@ public:
   }
   
   void draw() {
+    // GLKitなどアプリ外でステートが変わるので毎フレーム捨てる
+    glState().frame();
+#if defined (USE_GL_RECORDER)
+    glRecorder().begin();
+#endif
    if (proc_) proc_->draw();
+#if defined (USE_GL_RECORDER)
+    glRecorder().end();
+#endif
   }
 
   // GameCanterやTweet画面表示中にアプリの実行を止める
@@ -6,15 +6,52 @@
 //
 
 #include "co_miniEasing.hpp"
+#include <boost/noncopyable.hpp>
 #include "nn_vbo.hpp"
+#include "co_glState.hpp"
 
 
 namespace ngs {
 
 class AttackEffect : public ObjBase {
+public:
+  // リング描画用の頂点データ(全ての演出で共有)
+  // 頂点には分割位置と外周/内周の区別だけを持たせ、座標はシェーダーで求める
+  class Strip : private boost::noncopyable {
+    Vbo vtx_vbo_;
+
+  public:
+    explicit Strip(const int div_max) {
+      DOUT << "AttackEffect::Strip()" << std::endl;
+      
+      std::vector<GLfloat> vtx;
+      vtx.reserve((div_max + 1) * 4);
+      for (int i = 0; i <= div_max; ++i) {
+        // x:分割位置 y:0で外周、1で内周
+        vtx.push_back(i);
+        vtx.push_back(0.0f);
+        vtx.push_back(i);
+        vtx.push_back(1.0f);
+      }
+
+      gl_state.arrayBuffer(vtx_vbo_.handle());
+      glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vtx.size(), &vtx[0], GL_STATIC_DRAW);
+      gl_state.arrayBuffer(0);
+    }
+
+    ~Strip() {
+      DOUT << "~AttackEffect::Strip()" << std::endl;
+    }
+
+    GLuint handle() const { return vtx_vbo_.handle(); }
+  };
+
+  
+private:
   Framework& fw_;
   const picojson::value& params_;
   const Camera& camera_;
+  const Strip& strip_;
 
   std::shared_ptr<EasyShader> shader_;
   
@@ -30,6 +67,7 @@ class AttackEffect : public ObjBase {
   float div_gap_;
   int div_max_;
   int div_min_;
+  int div_;
   
   MiniEasing<float> radius_ease_;
   Ease<GrpCol> color_ease_;
@@ -38,16 +76,14 @@ class AttackEffect : public ObjBase {
   Quatf rotate_;
   Eigen::Affine3f matrix_;
 
-  int vtx_num_;
-  Vbo vtx_vbo_;
-
 
 public:
   AttackEffect(Framework& fw, const picojson::value& params,
-               ShaderHolder& shader_holder, const Camera& camera) :
+               ShaderHolder& shader_holder, const Camera& camera, const Strip& strip) :
     fw_(fw),
     params_(params.at("attack_effect")),
     camera_(camera),
+    strip_(strip),
     shader_(shader_holder.read(params_.at("shader").get<std::string>())),
     active_(true),
     updated_(false),
@@ -56,6 +92,7 @@ public:
     div_gap_(params_.at("div_gap").get<double>()),
     div_max_(params_.at("div_max").get<double>()),
     div_min_(params_.at("div_min").get<double>()),
+    div_(div_min_),
     radius_ease_(miniEasingFromJson<float>(params_.at("radius_ease"))),
     color_ease_(easeFromJson<GrpCol>(params_.at("color_ease")))
   {
@@ -126,53 +163,20 @@ private:
     radius_ = start_radius_ + radius_ease_(delta_time);
     color_  = color_ease_(delta_time);
 
-    // 外径と内径
-    float radius      = radius_;
-    float hole_radius = radius_ - width_;
-
     // 分割数は半径に比例する
-    float circle_len = radius * 2.0f * m_pi;
-    int div = minmax(int(circle_len / div_gap_), div_min_, div_max_);
-    // DOUT << "Attack div:" << div << std::endl;
-
-    float y      = std::sqrt(planet_radius_ * planet_radius_ - radius * radius) - planet_radius_;
-    float hole_y = std::sqrt(planet_radius_ * planet_radius_ - hole_radius * hole_radius) - planet_radius_;
-
-    // 頂点を格納するコンテナを用意。あらかじめ容量を確保しておく
-		std::vector<GLfloat> vtx;
-    vtx.reserve(div * 3);
-
-		for(int i = 0; i <= div; ++i) {
-      // 表面の頂点の並びにするために、角度をマイナス方向に計算
-			float r = m_pi * -2.0f * i / div;
-
-			float sin_a = std::sin(r);
-			float cos_a = std::cos(r);
-
-			vtx.push_back(radius * sin_a);
-      vtx.push_back(y);
-			vtx.push_back(radius * cos_a);
-			vtx.push_back(hole_radius * sin_a);
-      vtx.push_back(hole_y);
-			vtx.push_back(hole_radius * cos_a);
-		}
-
-    vtx_num_ = static_cast<int>(vtx.size()) / 3;
-    
-    // VBOに転送
-		glBindBuffer(GL_ARRAY_BUFFER, vtx_vbo_.handle());
-		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vtx.size(), &vtx[0], GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    float circle_len = radius_ * 2.0f * m_pi;
+    div_ = minmax(int(circle_len / div_gap_), div_min_, div_max_);
+    // DOUT << "Attack div:" << div_ << std::endl;
   }
 
   // 描画
   void draw(const Signal::Params& arguments) {
     if (!updated_) return;
 
-    glDepthMask(GL_FALSE);
+    fw_.glState().depthMask(false);
     fw_.glState().blend(true);
-    glBlendEquation(GL_FUNC_ADD);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    fw_.glState().blendEquation(GL_FUNC_ADD);
+    fw_.glState().blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     pushMatrix();
     multMatrix(matrix_.matrix());
@@ -184,22 +188,24 @@ private:
     glUniformMatrix4fv(shader.uniform("modelViewMatrix"), 1, GL_FALSE, model.data());
 
     glUniform4f(shader.uniform("material_diffuse"), color_(0), color_(1), color_(2), color_(3));
-    glUniform4f(shader.uniform("material_emissive"), 0.0f, 0.0f, 0.0f, 0.0f);
 
-    glBindBuffer(GL_ARRAY_BUFFER, vtx_vbo_.handle());
+    // 外径、幅、分割数、惑星の半径からシェーダーでリングを生成する
+    glUniform4f(shader.uniform("ring_param"), radius_, width_, div_, planet_radius_);
+
+    fw_.glState().arrayBuffer(strip_.handle());
 
     GLint position = shader.attrib("position");
     glEnableVertexAttribArray(position);
-    glVertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3, 0);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, vtx_num_);
+    glVertexAttribPointer(position, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 2, 0);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, (div_ + 1) * 2);
 
     glDisableVertexAttribArray(position);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    fw_.glState().arrayBuffer(0);
     
     popMatrix();
 
     fw_.glState().blend(false);
-    glDepthMask(GL_TRUE);
+    fw_.glState().depthMask(true);
   }
 
   
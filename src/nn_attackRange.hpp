@@ -5,6 +5,8 @@
 // 攻撃範囲表示
 //
 
+#include "nn_staticMesh.hpp"
+
 namespace ngs {
 
 class AttackRange : public ObjBase {
@@ -12,6 +14,8 @@ class AttackRange : public ObjBase {
   const Camera& camera_;
 
   std::shared_ptr<EasyShader> color_sh_;
+  // 半径1の円
+  StaticMesh circle_;
   
   bool active_;
   bool updated_;
@@ -35,6 +39,7 @@ public:
     fw_(fw),
     camera_(camera),
     color_sh_(shader_holder.read("color")),
+    circle_(GL_LINE_LOOP, circle(), { { "position", 3 } }),
     active_(true),
     updated_(false),
     pause_(false),
@@ -90,6 +95,17 @@ public:
 
   
 private:
+  static std::vector<GLfloat> circle() {
+    std::vector<GLfloat> vtx;
+    const int vtx_num = 20;
+    for (int i = 0; i < vtx_num; ++i) {
+      vtx.push_back(std::sin(m_pi * 2 * i / vtx_num));
+      vtx.push_back(0.0f);
+      vtx.push_back(std::cos(m_pi * 2 * i / vtx_num));
+    }
+    return vtx;
+  }
+
   void update(const Signal::Params& arguments) {
     if (pause_) return;
 
@@ -108,7 +124,7 @@ private:
     // いきなり描画が呼び出された場合には処理しないための措置
     if (!updated_) return;
     
-    glDepthMask(GL_FALSE);
+    fw_.glState().depthMask(false);
     glLineWidth(1.0f);
 
     pushMatrix();
@@ -126,25 +142,10 @@ private:
     glUniform4f(shader.uniform("material_diffuse"), 1.0f, 0.0f, 0.0f, 1.0f);
     glUniform4f(shader.uniform("material_emissive"), 0.0f, 0.0f, 0.0f, 0.0f);
 
-    struct Vtx {
-      float x, y, z;
-    };
-    Vtx vtx[20];
-    int vtx_num = ELEMSOF(vtx);
-    for (int i = 0; i < vtx_num; ++i) {
-      vtx[i].x = std::sin(m_pi * 2 * i / vtx_num) * radius_;
-      vtx[i].y = 0.0f;
-      vtx[i].z = std::cos(m_pi * 2 * i / vtx_num) * radius_;
-    }
-
-    GLint position = shader.attrib("position");
-    glEnableVertexAttribArray(position);
-    glVertexAttribPointer(position, 3, GL_FLOAT, GL_FALSE, sizeof(Vtx), vtx);
-    glDrawArrays(GL_LINE_LOOP, 0, vtx_num);
-    glDisableVertexAttribArray(position);
+    circle_.draw(shader);
     
     popMatrix();
-    glDepthMask(GL_TRUE);
+    fw_.glState().depthMask(true);
   }
 
   
@@ -158,9 +159,11 @@ private:
     radius_ = planet_radius_ * std::sin(angle_);
 
     rotate_.setFromTwoVectors(Vec3f::UnitY(), center);
+    // TIPS:円の大きさは行列で変える
     matrix_ =
       rotate_
-      * Eigen::Translation<float, 3>(0.0f, y_pos_, 0.0f);
+      * Eigen::Translation<float, 3>(0.0f, y_pos_, 0.0f)
+      * Eigen::Scaling(radius_, 1.0f, radius_);
   }
   
 };
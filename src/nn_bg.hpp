@@ -14,6 +14,7 @@
 #include "nn_shaderHolder.hpp"
 #include "nn_messages.hpp"
 #include "nn_objBase.hpp"
+#include "nn_staticMesh.hpp"
 
 
 namespace ngs {
@@ -29,27 +30,8 @@ class Bg : public ObjBase {
 
   std::shared_ptr<EasyShader> shader_;
 
-  struct Vtx {
-    float x_, y_;
-    
-    Vtx(const float x, const float y) :
-      x_(x),
-      y_(y)
-    {}
-  };
-  std::vector<Vtx> vtx_;
-
-  struct Color {
-    float r_, g_, b_, a_;
-
-    Color(const float r, const float g, const float b, const float a) :
-      r_(r),
-      g_(g),
-      b_(b),
-      a_(a)
-    {}
-  };
-  std::vector<Color> col_;
+  // 頂点座標と頂点カラー
+  StaticMesh mesh_;
 
   // 白ういろうピンチ演出用
   Vec3f       diffuse_;
@@ -67,29 +49,12 @@ public:
     updated_(false),
     pause_(false),
     shader_(shader_holder.read(params_.at("shader").get<std::string>())),
+    mesh_(GL_TRIANGLE_FAN, readVertex(params_), { { "position", 2 }, { "vtx_color", 4 } }),
     diffuse_(0.0f, 0.0f, 0.0f),
     light_effect_(false),
     light_effect_ease_(easeFromJson<Vec3f>(params_.at("light_effect")))
   {
     DOUT << "Bg()" << std::endl;
-
-    // 頂点データ読み込み
-    {
-      const auto& values = params_.at("vtx").get<picojson::array>();
-      for (const auto value : values) {
-        Vec2f v = vectFromJson<Vec2f>(value);
-        vtx_.emplace_back(v.x(), v.y());
-      }
-    }
-
-    // 頂点カラー読み込み
-    {
-      const auto& values = params_.at("color").get<picojson::array>();
-      for (const auto value : values) {
-        Vec4f v = vectFromJson<Vec4f>(value);
-        col_.emplace_back(v(0), v(1), v(2), v(3));
-      }
-    }
   }
 
   ~Bg() {
@@ -147,6 +112,22 @@ public:
 
 
 private:
+  // 頂点座標と頂点カラーを読み込んで、頂点ごとに並べる
+  static std::vector<GLfloat> readVertex(const picojson::value& params) {
+    const auto& vtx   = params.at("vtx").get<picojson::array>();
+    const auto& color = params.at("color").get<picojson::array>();
+    assert(vtx.size() == color.size());
+
+    std::vector<GLfloat> vertex;
+    for (size_t i = 0; i < vtx.size(); ++i) {
+      Vec2f v = vectFromJson<Vec2f>(vtx[i]);
+      Vec4f c = vectFromJson<Vec4f>(color[i]);
+      vertex.insert(vertex.end(), v.data(), v.data() + 2);
+      vertex.insert(vertex.end(), c.data(), c.data() + 4);
+    }
+    return vertex;
+  }
+
   void update(const Signal::Params& arguments) {
     if (pause_) return;
     updated_ = true;
@@ -167,6 +148,8 @@ private:
   void draw(const Signal::Params& arguments) {
     if (!updated_) return;
 
+    Profiler::Scope profile(fw_.profiler(), "bg", true);
+
     // 現在の透視変換を退避して背景用の透視変換を作成
     setMatrixMode(Matrix::PROJECTION);
     pushMatrix();
@@ -183,19 +166,7 @@ private:
     
     glUniform4f(shader.uniform("diffuse"), diffuse_(0), diffuse_(1), diffuse_(2), 1.0f);
     
-    GLint position = shader.attrib("position");
-    glEnableVertexAttribArray(position);
-    glVertexAttribPointer(position, 2, GL_FLOAT, GL_FALSE, sizeof(Vtx), &vtx_[0]);
-
-    GLint vtx_color = shader.attrib("vtx_color");
-    glEnableVertexAttribArray(vtx_color);
-    glVertexAttribPointer(vtx_color, 4, GL_FLOAT, GL_FALSE, sizeof(Color), &col_[0]);
-    
-    // glDrawArrays(GL_TRIANGLE_STRIP, 0, static_cast<GLsizei>(vtx_.size()));
-    glDrawArrays(GL_TRIANGLE_FAN, 0, static_cast<GLsizei>(vtx_.size()));
-
-    glDisableVertexAttribArray(position);
-    glDisableVertexAttribArray(vtx_color);
+    mesh_.draw(shader);
 
     fw_.glState().depthTest(true);
     fw_.glState().cullFace(true);
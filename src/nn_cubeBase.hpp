@@ -18,6 +18,7 @@
 #include "nn_shaderHolder.hpp"
 #include "nn_messages.hpp"
 #include "nn_objBase.hpp"
+#include "nn_visibility.hpp"
 #include "nn_cubeShadow.hpp"
 #include "nn_gameSound.hpp"
 
@@ -41,8 +42,8 @@ class CubeBase : public ObjBase {
 
   // 表示用モデル
   Model model_;
-  // オリジナルのマテリアル
-  std::deque<Material> materials_;
+  // 可視判定用の境界球
+  SphereVolume bounds_;
 
   // 表示用シェーダー
   std::shared_ptr<EasyShader> shader_;
@@ -110,16 +111,15 @@ class CubeBase : public ObjBase {
   float face_change_time_;
   
   // 影
-  CubeShadow      shadow_;
-  Eigen::Affine3f shadow_matrix_;
-  GrpCol          shadow_color_;
+  CubeShadow::Prim shadow_;
+  Eigen::Affine3f  shadow_matrix_;
+  GrpCol           shadow_color_;
   
   
 public:
   CubeBase(Framework& fw,
            const picojson::value& params,
-           ModelHolder& model_holder, ShaderHolder& shader_holder,
-           const CubeShadow& shadow) :
+           ModelHolder& model_holder, ShaderHolder& shader_holder) :
     fw_(fw),
     params_(params.at("cubeBase")),
     active_(true),
@@ -130,7 +130,7 @@ public:
 #endif
     hash_(createUniqueNumber()),
     model_(model_holder.read(params_.at("model").get<std::string>())),
-    // materials_(model_.material()),
+    bounds_(Visibility::boundingSphere(model_)),
     shader_(shader_holder.read(params_.at("shader").get<std::string>())),
     radius_(params_.at("radius").get<double>()),
     scale_(radius_ * 2.0f),
@@ -156,7 +156,6 @@ public:
     face_damage_(params_.at("face_damage").get<std::string>()),
     face_wounded_(params_.at("face_wounded").get<std::string>()),
     face_change_time_(0.0f),
-    shadow_(shadow),
     shadow_matrix_(Eigen::Affine3f::Identity()),
     shadow_color_(vectFromJson<GrpCol>(params_.at("shadow_color")))
   {
@@ -172,7 +171,6 @@ public:
     
     // FIXME:マテリアルのdeffuseだけ書き換える(colladaがテクスチャ付きのに対応していない)
     Model::materialDiffuseColor(model_, vectFromJson<Vec3f>(params_.at("material_deffuse")));
-    materials_ = model_.material();
 
     // ダメージ効果演出は止めておく
     hit_effect_.stop();
@@ -290,10 +288,10 @@ private:
       immortal_time_ -= delta_time;
       immortal_ = (immortal_time_ > 0.0f);
 
-      Model::materialEmissiveColor(model_, materials_, immortal_ ? immortal_ease_(delta_time) : Vec3f::Zero());
+      Model::materialEmissiveColor(model_, 1.0f, immortal_ ? immortal_ease_(delta_time) : Vec3f::Zero());
     }
     else if (hit_effect_.isExec()) {
-      Model::materialEmissiveColor(model_, materials_, hit_effect_(delta_time));
+      Model::materialEmissiveColor(model_, 1.0f, hit_effect_(delta_time));
     }
 
     // 表情変化
@@ -329,7 +327,7 @@ private:
 
     // 影の濃さを決める
     float d = (45.0f - minmax(y_pos_ - planet_radius_, 0.0f, 45.0f)) / 45.0f;
-    shadow_.color(shadow_color_ * d);
+    shadow_.color = shadow_color_ * d;
 
 #ifdef _DEBUG
     char key = fw_.keyboard().getPushed();
@@ -362,8 +360,17 @@ private:
     // いきなり描画が呼び出された場合には処理しないための措置
     if (!updated_) return;
 
-    modelDraw(model_, model_matrix_.matrix(), *shader_, true);
-    shadow_.draw(fw_, shadow_matrix_.matrix());
+    // 惑星の裏側や画面外にあるものは描画しない
+    auto visibility = boost::any_cast<Visibility*>(arguments.at("visibility"));
+    if (visibility->isVisible(bounds_, model_matrix_.matrix())) {
+      modelDraw(model_, model_matrix_.matrix(), *shader_, true);
+    }
+
+    // 影はまとめて描画する
+    if (visibility->isVisible(shadow_matrix_.translation(), shadow_.radius)) {
+      auto shadow_prims = boost::any_cast<CubeShadow::PrimPack*>(arguments.at("shadow_prims"));
+      CubeShadow::pushPrim(*shadow_prims, shadow_, shadow_matrix_.matrix());
+    }
   }
 
   
@@ -376,7 +383,9 @@ private:
       rotate_.setFromTwoVectors(Vec3f::UnitY(), pos);
     }
 
-    shadow_.setup(radius_ + params_.at("shadow_radius").get<double>(), planet_radius_, 0.2f);
+    shadow_.radius        = radius_ + params_.at("shadow_radius").get<double>();
+    shadow_.planet_radius = planet_radius_;
+    shadow_.gap           = 0.2f;
   }
   
   // 情報を返す
@@ -534,11 +543,7 @@ private:
   // HPが減るにつれて色が黒くなる効果
   void hpToColor() {
     float rate = float(hp_) / hp_max_;
-    std::deque<Material>& model_materials = model_.material();
-    for (u_int i = 0; i < materials_.size(); ++i) {
-      Vec3f col(materials_[i].diffuse() * rate);
-      model_materials[i].diffuse(col);
-    }
+    Model::materialDiffuseRate(model_, rate);
   }
   
 };
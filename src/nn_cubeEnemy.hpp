@@ -19,6 +19,7 @@
 #include "nn_shaderHolder.hpp"
 #include "nn_messages.hpp"
 #include "nn_objBase.hpp"
+#include "nn_visibility.hpp"
 #include "nn_cpuFactory.hpp"
 #include "co_miniQuake.hpp"
 #include "co_quakeParam.hpp"
@@ -38,8 +39,8 @@ class CubeEnemy : public ObjBase {
   u_int hash_;
   
   Model model_;
-  // オリジナルのマテリアル
-  std::deque<Material> materials_;
+  // 可視判定用の境界球
+  SphereVolume bounds_;
 
   std::shared_ptr<EasyShader> shader_;
 
@@ -134,9 +135,9 @@ class CubeEnemy : public ObjBase {
   float      quake_move_rate_;
   
   // 影
-  CubeShadow      shadow_;
-  Eigen::Affine3f shadow_matrix_;
-  GrpCol          shadow_color_;
+  CubeShadow::Prim shadow_;
+  Eigen::Affine3f  shadow_matrix_;
+  GrpCol           shadow_color_;
 
   
 public:
@@ -144,8 +145,7 @@ public:
             const picojson::value& params,
             const std::string& name,
             CpuFactory& cpu_factory,
-            ModelHolder& model_holder, ShaderHolder& shader_holder,
-            const CubeShadow& shadow) :
+            ModelHolder& model_holder, ShaderHolder& shader_holder) :
     fw_(fw),
     params_(params.at(name)),
     cpu_factory_(cpu_factory),
@@ -154,7 +154,7 @@ public:
     pause_(false),
     hash_(createUniqueNumber()),
     model_(model_holder.read(params_.at("model").get<std::string>())),
-    // materials_(model_.material()),
+    bounds_(Visibility::boundingSphere(model_)),
     shader_(shader_holder.read(params_.at("shader").get<std::string>())),
     radius_(randomValue(vectFromJson<Vec2f>(params_.at("radius")))),
     scale_(radius_ * 2.0f),
@@ -187,7 +187,6 @@ public:
     quake_damage_(params_.at("quake_damage")),
     quake_move_(params_.at("quake_move")),
     quake_move_rate_(params_.at("quake_move_rate").get<double>()),
-    shadow_(shadow),
     shadow_matrix_(Eigen::Affine3f::Identity()),
     shadow_color_(vectFromJson<GrpCol>(params_.at("shadow_color")))
   {
@@ -198,7 +197,6 @@ public:
 
     // FIXME:マテリアルのdeffuseだけ書き換える(colladaがテクスチャ付きのに対応していない)
     Model::materialDiffuseColor(model_, vectFromJson<Vec3f>(params_.at("material_deffuse")));
-    materials_ = model_.material();
 
     // 消滅演出を止めておく
     disappear_.stop();
@@ -385,7 +383,7 @@ private:
 
     // 影の濃さを決める
     float d = (50.0f - minmax(y_pos_ - planet_radius_, 0.0f, 50.0f)) / 50.0f;
-    shadow_.color(shadow_color_ * d * disappear_scale_);
+    shadow_.color = shadow_color_ * d * disappear_scale_;
   }
 
   // 描画
@@ -393,8 +391,17 @@ private:
     // いきなり描画が呼び出された場合には処理しないための措置
     if (!updated_) return;
     
-    modelDraw(model_, model_matrix_.matrix(), *shader_, true);
-    shadow_.draw(fw_, shadow_matrix_.matrix());
+    // 惑星の裏側や画面外にあるものは描画しない
+    auto visibility = boost::any_cast<Visibility*>(arguments.at("visibility"));
+    if (visibility->isVisible(bounds_, model_matrix_.matrix())) {
+      modelDraw(model_, model_matrix_.matrix(), *shader_, true);
+    }
+
+    // 影はまとめて描画する
+    if (visibility->isVisible(shadow_matrix_.translation(), shadow_.radius)) {
+      auto shadow_prims = boost::any_cast<CubeShadow::PrimPack*>(arguments.at("shadow_prims"));
+      CubeShadow::pushPrim(*shadow_prims, shadow_, shadow_matrix_.matrix());
+    }
   }
 
   // 消滅演出
@@ -683,7 +690,7 @@ private:
       else {
         // HPが減ったら赤くする
         float rate = 1.0f - float(hp_) / hp_max_;
-        modifyDiffuseColor(model_, materials_, wounded_color_ * rate);
+        Model::materialDiffuseAdd(model_, wounded_color_ * rate);
       }
       destroyAction(pos);
     }
@@ -850,7 +857,9 @@ private:
     force_stiff_      = boost::any_cast<bool>(arguments.at("force_stiff"));
     force_stiff_time_ = boost::any_cast<float>(arguments.at("force_stiff_time"));
     
-    shadow_.setup(radius_ + params_.at("shadow_radius").get<double>(), planet_radius_, 0.05f);
+    shadow_.radius        = radius_ + params_.at("shadow_radius").get<double>();
+    shadow_.planet_radius = planet_radius_;
+    shadow_.gap           = 0.05f;
   }
 
   // アイテム効果で硬直
@@ -858,15 +867,6 @@ private:
     force_stiff_      = true;
     force_stiff_time_ = boost::any_cast<float>(arguments.at("effect_time"));
   }
-
-
-  // マテリアルカラーに色を加える
-  static void modifyDiffuseColor(Model& model, const std::deque<Material>& materials_src, const Vec3f& col) {
-    std::deque<Material>& materials = model.material();
-    for (u_int i = 0; i < materials.size(); ++i) {
-      materials[i].diffuse(materials_src[i].diffuse() + col);
-    }
-  }
   
 };
 
@@ -16,6 +16,7 @@
 #include "nn_shaderHolder.hpp"
 #include "nn_messages.hpp"
 #include "nn_objBase.hpp"
+#include "nn_visibility.hpp"
 
 
 namespace ngs {
@@ -32,8 +33,8 @@ class CubeItem : public ObjBase {
 
   // 表示用モデル
   Model model_;
-  // オリジナルのマテリアル
-  std::deque<Material> materials_;
+  // 可視判定用の境界球
+  SphereVolume bounds_;
 
   // 表示用シェーダー
   std::shared_ptr<EasyShader> shader_;
@@ -88,7 +89,7 @@ class CubeItem : public ObjBase {
   // 効果演出用
   Ease<float> effect_ease_;
 
-  CubeShadow        shadow_;
+  CubeShadow::Prim  shadow_;
   Eigen::Affine3f   shadow_matrix_;
   GrpCol            shadow_color_;
   MiniEasing<float> shadow_fade_;
@@ -97,8 +98,7 @@ class CubeItem : public ObjBase {
 public:
   CubeItem(Framework& fw,
            const picojson::value& params,
-           ModelHolder& model_holder, ShaderHolder& shader_holder,
-           const CubeShadow& shadow) :
+           ModelHolder& model_holder, ShaderHolder& shader_holder) :
     fw_(fw),
     params_(params.at("cubeItem")),
     active_(true),
@@ -106,7 +106,7 @@ public:
     pause_(false),
     hash_(createUniqueNumber()),
     model_(model_holder.read(params_.at("model").get<std::string>())),
-    materials_(model_.material()),
+    bounds_(Visibility::boundingSphere(model_)),
     shader_(shader_holder.read(params_.at("shader").get<std::string>())),
     radius_(params_.at("radius").get<double>()),
     scale_(radius_ * 2.0f),
@@ -127,7 +127,6 @@ public:
     effect_time_(params_.at("effect_time").get<double>()),
     color_ease_(easeFromJson<float>(params_.at("color_disp"))),
     effect_ease_(easeFromJson<float>(params_.at("effect_ease"))),
-    shadow_(shadow),
     shadow_matrix_(Eigen::Affine3f::Identity()),
     shadow_color_(vectFromJson<GrpCol>(params_.at("shadow_color"))),
     shadow_fade_(miniEasingFromJson<float>(params_.at("shadow_fade_in"))),
@@ -263,7 +262,7 @@ private:
         d *= shadow_fade_(delta_time);
         if (!shadow_fade_.isExec() && disappear_) shadow_disp_ = false;
       }
-      shadow_.color(shadow_color_ * d);
+      shadow_.color = shadow_color_ * d;
     }
   }
 
@@ -272,8 +271,16 @@ private:
     // いきなり描画が呼び出された場合には処理しないための措置
     if (!updated_) return;
 
-    modelDraw(model_, model_matrix_.matrix(), *shader_, true);
-    if (shadow_disp_) shadow_.draw(fw_, shadow_matrix_.matrix());
+    // 惑星の裏側や画面外にあるものは描画しない
+    auto visibility = boost::any_cast<Visibility*>(arguments.at("visibility"));
+    if (visibility->isVisible(bounds_, model_matrix_.matrix())) {
+      modelDraw(model_, model_matrix_.matrix(), *shader_, true);
+    }
+    if (shadow_disp_ && visibility->isVisible(shadow_matrix_.translation(), shadow_.radius)) {
+      // 影はまとめて描画する
+      auto shadow_prims = boost::any_cast<CubeShadow::PrimPack*>(arguments.at("shadow_prims"));
+      CubeShadow::pushPrim(*shadow_prims, shadow_, shadow_matrix_.matrix());
+    }
   }
 
 
@@ -372,7 +379,9 @@ private:
     Vec3f pos = boost::any_cast<Vec3f>(arguments.at("spawn_pos"));
     rotate_.setFromTwoVectors(Vec3f::UnitY(), pos);
 
-    shadow_.setup(radius_ + params_.at("shadow_radius").get<double>(), planet_radius_, 0.04f);
+    shadow_.radius        = radius_ + params_.at("shadow_radius").get<double>();
+    shadow_.planet_radius = planet_radius_;
+    shadow_.gap           = 0.04f;
   }
 
   bool canGet() const {
@@ -18,6 +18,7 @@
 #include "nn_shaderHolder.hpp"
 #include "nn_messages.hpp"
 #include "nn_objBase.hpp"
+#include "nn_visibility.hpp"
 #include "nn_cubeShadow.hpp"
 #include "nn_gameSound.hpp"
 #include "gamecenter.h"
@@ -42,8 +43,8 @@ class CubePlayer : public ObjBase {
   u_int hash_;
 
   Model model_;
-  // オリジナルのマテリアル
-  std::deque<Material> materials_;
+  // 可視判定用の境界球
+  SphereVolume bounds_;
 
   std::shared_ptr<EasyShader> shader_;
 
@@ -154,17 +155,16 @@ class CubePlayer : public ObjBase {
   float face_change_time_;
   
   // 影
-  CubeShadow      shadow_;
-  Eigen::Affine3f shadow_matrix_;
-  GrpCol          shadow_color_;
+  CubeShadow::Prim shadow_;
+  Eigen::Affine3f  shadow_matrix_;
+  GrpCol           shadow_color_;
 
   
 public:
   CubePlayer(Framework& fw,
              const picojson::value& params,
              const Camera& camera,
-             ModelHolder& model_holder, ShaderHolder& shader_holder,
-             const CubeShadow& shadow) :
+             ModelHolder& model_holder, ShaderHolder& shader_holder) :
     fw_(fw),
     params_(params.at("cubePlayer")),
     camera_(camera),
@@ -177,7 +177,7 @@ public:
     demo_mode_(false),
     hash_(createUniqueNumber()),
     model_(model_holder.read(params_.at("model").get<std::string>())),
-    // materials_(model_.material()),
+    bounds_(Visibility::boundingSphere(model_)),
     shader_(shader_holder.read(params_.at("shader").get<std::string>())),
     radius_(params_.at("radius").get<double>()),
     scale_(radius_ * 2.0f),
@@ -209,7 +209,6 @@ public:
     face_normal_(params_.at("face_normal").get<std::string>()),
     face_attack_(params_.at("face_attack").get<std::string>()),
     face_change_time_(0.0f),
-    shadow_(shadow),
     shadow_matrix_(Eigen::Affine3f::Identity()),
     shadow_color_(vectFromJson<GrpCol>(params_.at("shadow_color")))
   {
@@ -220,7 +219,6 @@ public:
     
     // FIXME:マテリアルのdeffuseだけ書き換える(colladaがテクスチャ付きのに対応していない)
     Model::materialDiffuseColor(model_, vectFromJson<Vec3f>(params_.at("material_deffuse")));
-    materials_ = model_.material();
   }
 
   ~CubePlayer() {
@@ -477,7 +475,7 @@ private:
 
     // 影の濃さを決める
     float d = (45.0f - minmax(y_pos_ - planet_radius_, 0.0f, 45.0f)) / 45.0f;
-    shadow_.color(shadow_color_ * d);
+    shadow_.color = shadow_color_ * d;
 
 #ifdef _DEBUG
     // 強制アイテム発動
@@ -490,8 +488,17 @@ private:
     // いきなり描画が呼び出された場合には処理しないための措置
     if (!updated_) return;
     
-    modelDraw(model_, model_matrix_.matrix(), *shader_, true);
-    shadow_.draw(fw_, shadow_matrix_.matrix());
+    // 惑星の裏側や画面外にあるものは描画しない
+    auto visibility = boost::any_cast<Visibility*>(arguments.at("visibility"));
+    if (visibility->isVisible(bounds_, model_matrix_.matrix())) {
+      modelDraw(model_, model_matrix_.matrix(), *shader_, true);
+    }
+
+    // 影はまとめて描画する
+    if (visibility->isVisible(shadow_matrix_.translation(), shadow_.radius)) {
+      auto shadow_prims = boost::any_cast<CubeShadow::PrimPack*>(arguments.at("shadow_prims"));
+      CubeShadow::pushPrim(*shadow_prims, shadow_, shadow_matrix_.matrix());
+    }
   }
 
 
@@ -674,7 +681,9 @@ private:
     pos_   = rotate_ * Vec3f::UnitY();
     angle_ = rotate_ * Vec3f::UnitX();
 
-    shadow_.setup(radius_ + params_.at("shadow_radius").get<double>(), planet_radius_, 0.04f);
+    shadow_.radius        = radius_ + params_.at("shadow_radius").get<double>();
+    shadow_.planet_radius = planet_radius_;
+    shadow_.gap           = 0.04f;
   }
 
 
@@ -808,20 +817,13 @@ private:
       Vec3f effect_color = item_effect_color_ * color_ease;
 
       // エミッシブを書き換える
-      std::deque<Material>& model_materials = model_.material();
-      for (u_int i = 0; i < materials_.size(); ++i) {
-        Vec3f col = materials_[i].emissive() * (1.0f - color_ease) + effect_color;
-        model_materials[i].emissive(col);
-      }
+      Model::materialEmissiveColor(model_, 1.0f - color_ease, effect_color);
     }
     else {
       item_effect_ = false;
 
       // エミッシブを元に戻す
-      std::deque<Material>& model_materials = model_.material();
-      for (u_int i = 0; i < materials_.size(); ++i) {
-        model_materials[i].emissive(materials_[i].emissive());
-      }
+      Model::materialEmissiveColor(model_, 1.0f, Vec3f::Zero());
     }
   }
 
@@ -3,14 +3,18 @@
 
 //
 // 影オブジェクト
+// 形状は全ての影で共有し、まとめて描画する
 //
 
+#include <vector>
+#include <boost/noncopyable.hpp>
 #include "nn_vbo.hpp"
+#include "co_glState.hpp"
 
 
 namespace ngs {
 
-class CubeShadow {
+class CubeShadow : private boost::noncopyable {
   // モデルデータを読み込む時の設定
   enum {
     import_flags = aiProcess_Triangulate |
@@ -31,7 +35,6 @@ class CubeShadow {
     Vtx vtx;
     Uv uv;
   };
-  std::deque<Body> body_;
 
   // 面データ定義
 	struct Face {
@@ -41,20 +44,32 @@ class CubeShadow {
   GLuint points_;
 
   // VBO
+  // TIPS:惑星表面への投影はシェーダーで行うので、全ての影で共有できる
   Vbo vtx_vbo_;
-  std::shared_ptr<Vbo> face_vbo_;
-
-  GrpCol color_;
+  Vbo face_vbo_;
 
   std::shared_ptr<Texture> texture_;
   std::shared_ptr<EasyShader> shader_;
   
   
 public:
+  // 影１つぶんの表示情報
+  struct Prim {
+    Mat4f  matrix;
+    GrpCol color;
+
+    // 影の半径
+    float radius;
+    // 惑星の半径
+    float planet_radius;
+    // 地表からの隙間
+    float gap;
+  };
+  typedef std::vector<Prim> PrimPack;
+
+  
   CubeShadow(const std::string& model_file, const std::string& texture_file,
              ShaderHolder& shader_holder) :
-    face_vbo_(std::make_shared<Vbo>()),
-    color_(0.0f, 0.0f, 0.0f, 1.0f),
     texture_(std::make_shared<Texture>(texture_file)),
     shader_(shader_holder.read("shadow"))
   {
@@ -68,6 +83,7 @@ public:
     }
     DOUT << "Mesh:" << scene->mNumMeshes << std::endl;
 
+    std::vector<Body> body;
     std::vector<Face> faces;
 
     // メッシュ生成
@@ -75,7 +91,7 @@ public:
       const aiMesh& mesh = *(scene->mMeshes[i]);
 
       // 先に面データ生成
-      const GLushort face_index = static_cast<GLushort>(body_.size());
+      const GLushort face_index = static_cast<GLushort>(body.size());
       aiFace* f = mesh.mFaces;
       for (u_int fi = 0; fi < mesh.mNumFaces; ++fi) {
         // 三角ポリゴン以外はエラー
@@ -94,11 +110,11 @@ public:
       const aiVector3D* v  = mesh.mVertices;
       const aiVector3D* uv = mesh.mTextureCoords[0];
       for (u_int vi = 0; vi < mesh.mNumVertices; ++vi) {
-        Body body = {
+        Body b = {
           { v->x, v->y, v->z },
           { uv->x, uv->y }
         };
-        body_.push_back(body);
+        body.push_back(b);
 
         ++v;
         ++uv;
@@ -108,10 +124,14 @@ public:
     // 描画総頂点数
     points_ = static_cast<GLuint>(faces.size() * 3);
 
-    // 面データは転送しておく
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, face_vbo_->handle());
+    // 頂点データと面データは一度だけ転送しておく
+		gl_state.arrayBuffer(vtx_vbo_.handle());
+		glBufferData(GL_ARRAY_BUFFER, sizeof(Body) * body.size(), &body[0], GL_STATIC_DRAW);
+    gl_state.arrayBuffer(0);
+
+		gl_state.elementArrayBuffer(face_vbo_.handle());
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Face) * faces.size(), &faces[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    gl_state.elementArrayBuffer(0);
   }
 
   ~CubeShadow() {
@@ -119,52 +139,31 @@ public:
   }
 
 
-  // 影の半径と惑星の半径から最終的なデータを生成
-  void setup(const float radius, const float planet_radius, const float gap) const {
-    // VBOに転送する頂点データ(あらかじめ容量を割り当てておく)
-    std::vector<Body> body;
-    body.reserve(body_.size());
-
-    // 影の半径と惑星の半径から各頂点を再計算する
-    for (auto b : body_) {
-      b.vtx.x *= radius;
-      b.vtx.z *= radius;
-      float len = std::sqrt(b.vtx.x * b.vtx.x + b.vtx.z * b.vtx.z);
-      b.vtx.y = std::sqrt(planet_radius * planet_radius - len * len) - planet_radius + gap;
-      body.push_back(b);
-    }
-
-    // VBOに転送
-		glBindBuffer(GL_ARRAY_BUFFER, vtx_vbo_.handle());
-		glBufferData(GL_ARRAY_BUFFER, sizeof(Body) * body.size(), &body[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  // 描画プリミティブを積む
+  // 現在のモデル行列を掛け合わせておくので、まとめて描画する時に行列の状態を気にしなくてよい
+  static void pushPrim(PrimPack& prim_pack, const Prim& prim, const Mat4f& matrix) {
+    prim_pack.push_back(prim);
+    prim_pack.back().matrix = getModelMatrix() * matrix;
   }
+  
 
-  void color(const GrpCol& col) { color_ = col; }
-
-
-  void draw(Framework& fw, const Mat4f& matrix) const {
+  // 積まれた影をまとめて描画
+  void draw(Framework& fw, const PrimPack& prim_pack) const {
+    if (prim_pack.empty()) return;
+    
     const EasyShader& shader = *shader_;
 
     // TIPS:iOSのsnapshotの不具合っぽいのがあるので、
     //      ブレンディングを「引き算」にしておく
     fw.glState().blend(true);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    glBlendEquation(GL_FUNC_REVERSE_SUBTRACT);
-    glDepthMask(GL_FALSE);
+    fw.glState().blendFunc(GL_SRC_ALPHA, GL_ONE);
+    fw.glState().blendEquation(GL_FUNC_REVERSE_SUBTRACT);
+    fw.glState().depthMask(false);
     
     shader();
 
-    pushMatrix();
-    multMatrix(matrix);
-    
-    // glUniformMatrix4fv(shader.uniform("projectionMatrix"), 1, GL_FALSE, getProjectionMatrix().data());
-    glUniformMatrix4fv(shader.uniform("modelViewMatrix"), 1, GL_FALSE, getModelMatrix().data());
-
-    glUniform4f(shader.uniform("material_diffuse"), color_(0), color_(1), color_(2), color_(3));
-    
-    glBindBuffer(GL_ARRAY_BUFFER, vtx_vbo_.handle());
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, face_vbo_->handle());
+    fw.glState().arrayBuffer(vtx_vbo_.handle());
+		fw.glState().elementArrayBuffer(face_vbo_.handle());
     
     GLint position = shader.attrib("position");
     glEnableVertexAttribArray(position);
@@ -176,20 +175,25 @@ public:
 
     glUniform1i(shader.uniform("sampler"), 0);
     texture_->bind();
+
+    // 影ごとに変わるのは行列と色と投影パラメーターだけ
+    for (const auto& prim : prim_pack) {
+      glUniformMatrix4fv(shader.uniform("modelViewMatrix"), 1, GL_FALSE, prim.matrix.data());
+      glUniform4f(shader.uniform("material_diffuse"), prim.color(0), prim.color(1), prim.color(2), prim.color(3));
+      glUniform3f(shader.uniform("shadow_param"), prim.radius, prim.planet_radius, prim.gap);
     
-    glDrawElements(GL_TRIANGLES, points_, GL_UNSIGNED_SHORT, 0);
+      glDrawElements(GL_TRIANGLES, points_, GL_UNSIGNED_SHORT, 0);
+    }
 
     glDisableVertexAttribArray(position);
     glDisableVertexAttribArray(uv);
     texture_->unbind();
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    fw.glState().arrayBuffer(0);
+    fw.glState().elementArrayBuffer(0);
     
-    popMatrix();
-
     fw.glState().blend(false);
-    glDepthMask(GL_TRUE);
+    fw.glState().depthMask(true);
   }
   
 };
@@ -3,16 +3,17 @@
 
 //
 // オフスクリーンバッファ
-// サイズは２のべき乗であること
+// TIPS:ES 2.0でもCLAMP_TO_EDGEでミップマップなしなら２のべき乗でなくてよい
 //
 
-namespace ngs {
-
 #include "co_defines.hpp"
 #include <boost/noncopyable.hpp>
 #include "co_vector.hpp"
+#include "co_glState.hpp"
 
 
+namespace ngs {
+
 class Fbo : private boost::noncopyable {
   Vec2i size_;
   GLuint texture_id_;
@@ -28,7 +29,7 @@ public:
 
     // オフスクリーンレンダリング用のテクスチャを生成
     glGenTextures(1, &texture_id_);
-    glBindTexture(GL_TEXTURE_2D, texture_id_);
+    gl_state.texture(texture_id_);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size.x(), size.y(), 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -37,7 +38,7 @@ public:
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
     // 初期化が終わったら拘束を解除
-    glBindTexture(GL_TEXTURE_2D, 0);
+    gl_state.texture(0);
 
     // オフスクリーンレンダリング用の深度バッファを生成
     glGenRenderbuffers(1, &depth_id_);
@@ -72,18 +73,23 @@ public:
   ~Fbo() {
     // 各種リソースを破棄
     glDeleteFramebuffers(1, &framebuffer_id_);
-    glDeleteTextures(1, &texture_id_);
+    gl_state.deleteTexture(texture_id_);
     glDeleteRenderbuffers(1, &depth_id_);
     
   }
 
 
   GLint bind() const {
+    return bind(size_);
+  }
+
+  // 一部分だけに描画する
+  GLint bind(const Vec2i& viewport) const {
     GLint current_fbo;
     glGetIntegerv(GL_FRAMEBUFFER_BINDING, &current_fbo);
 
     glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_id_);	
-    glViewport(0, 0, size_.x(), size_.y());
+    gl_state.viewport(0, 0, viewport.x(), viewport.y());
 
     return current_fbo;
   }
@@ -93,8 +99,10 @@ public:
   }
 
   void bindTexture() const {
-    glBindTexture(GL_TEXTURE_2D, texture_id_);
+    gl_state.texture(texture_id_);
   }
+
+  const Vec2i& size() const { return size_; }
   
   
 private:
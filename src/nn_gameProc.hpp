@@ -7,7 +7,9 @@
 
 #include "co_defines.hpp"
 #include <algorithm>
+#include <array>
 #include <list>
+#include <vector>
 #include <sstream>
 #include <iterator>
 #include "co_json.hpp"
@@ -45,9 +47,12 @@
 #include "nn_awaitTap.hpp"
 #include "nn_skipTap.hpp"
 #include "nn_cubeShadow.hpp"
+#include "nn_visibility.hpp"
 #include "nn_gameSound.hpp"
 #include "nn_settings.hpp"
 #include "nn_demoLogic.hpp"
+#include "nn_renderScale.hpp"
+#include "nn_profileView.hpp"
 #include "sns.h"
 #include "gamecenter.h"
 
@@ -65,10 +70,15 @@ class GameProc : public ProcBase {
   QuakeCamera quake_camera_;
 
   std::pair<Vec3f, Light> lights_[3];
+  // シェーダーに設定済みの光源
+  Light uploaded_lights_[3];
+  bool lights_uploaded_;
 
 #ifdef _DEBUG
   bool draw_text_only_;
   bool draw_text_;
+  // 可視判定の結果を表示
+  bool disp_visibility_;
 #endif
 
   bool input_record_;
@@ -80,7 +90,14 @@ class GameProc : public ProcBase {
   // シェーダーの簡単なキャッシュ
   ShaderHolder shader_holder_;
   // ういろうの影
-  CubeShadow shadow_;
+  CubeShadow           shadow_;
+  CubeShadow::PrimPack shadow_prims_;
+  // 可視判定
+  Visibility visibility_;
+  // 攻撃演出のリング
+  AttackEffect::Strip attack_strip_;
+  // 3D描画の解像度
+  RenderScale render_scale_;
   
   // メニュー操作
   TouchWidget touch_widget_;
@@ -100,9 +117,11 @@ class GameProc : public ProcBase {
   MatrixFont number_font_;
   MatrixFont kana_font_;
   MatrixFont icon_font_;
-  Vbo        font_vbo_;
 
   MatrixFont::PrimPack text_prims_;
+
+  // 処理時間の表示
+  ProfileView profile_view_;
   
   bool pause_;
 
@@ -117,21 +136,26 @@ public:
             game_params_.at("camera_near_z").get<double>(),
             game_params_.at("camera_far_z").get<double>()),
     camera_2d_(fw.view().size(), 1.0f),
+    lights_uploaded_(false),
 #ifdef _DEBUG
     draw_text_only_(false),
     draw_text_(true),
+    disp_visibility_(false),
 #endif
     input_record_(false),
     input_playback_(false),
     fix_framerate_(false),
     model_holder_(fw.loadPath()),
-    shader_holder_(fw.loadPath()),
+    shader_holder_(fw.loadPath(), fw.savePath()),
     planet_radius_(game_params_.at("planet_radius").get<double>()),
     font_(fw.loadPath() + "font.json"),
     number_font_(fw.loadPath() + "number.json"),
     kana_font_(fw.loadPath() + "kana.json"),
     icon_font_(fw.loadPath() + "icon.json"),
+    profile_view_(font_, 2.0f, 1000.0f / 60.0f),
     shadow_(fw_.loadPath() + "shadow.dae", fw_.loadPath() + "shadow.png", shader_holder_),
+    attack_strip_(params_.at("attack_effect").at("div_max").get<double>()),
+    render_scale_(game_params_.at("render_scale")),
     touch_widget_(fw),
     pause_(false)
   {
@@ -139,6 +163,13 @@ public:
 
     // テキスト描画用のバッファを予約
     text_prims_.vtxes.reserve(2048);
+    // 影描画用のバッファを予約
+    shadow_prims_.reserve(128);
+
+#if !(TARGET_OS_IPHONE)
+    // ES 2.0以外:テキストのドットの大きさをシェーダーで決めるのに必要
+    glEnable(GL_VERTEX_PROGRAM_POINT_SIZE);
+#endif
     
     // サウンド
     Audio::listenerPosition(Vec3f::Zero());
@@ -151,12 +182,27 @@ public:
     // 描画バッファの消去色を指示
     fw_.view().clearColor(vectFromJson<GrpCol>(game_params_.at("clear_color")));
 
+#if defined (USE_GPU_TIMER)
+    // GPU時間で3D描画の解像度を決めるので、計測は常に行う
+    fw_.profiler().active(true);
+#endif
+
     // 光源設定
     initLights(game_params_.at("lights"));
+    prepareLightShaders();
     
     // カメラ設定
 		camera_.eye() = vectFromJson<Vec3f>(game_params_.at("camera_eye"));
 
+    // キューブの表情テクスチャは1枚のアトラスにまとめる
+    {
+      std::vector<std::string> files;
+      for (const auto& file : game_params_.at("texture_atlas").get<picojson::array>()) {
+        files.push_back(file.get<std::string>());
+      }
+      model_holder_.textureAtlas("face_atlas", files);
+    }
+
     // 自分自身をシグナルに登録
     signal_handle_ = fw_.signal().connect(*this);
 
@@ -177,6 +223,12 @@ public:
     // 舞台となる惑星
     spawnObject<Planet>(fw_, objects_,
                         params_, model_holder_, shader_holder_, planet_radius_);
+
+    // ゲーム中に使うモデルを先に読み込んでおく
+    for (const auto& model : game_params_.at("preload_models").get<picojson::array>()) {
+      model_holder_.read(model.get<std::string>());
+    }
+    model_holder_.finish();
     
     // タイトル画面開始
     Signal::Params params;
@@ -192,8 +244,15 @@ public:
 
   // 更新
   void update(const float delta_time) {
+    Profiler& profiler = fw_.profiler();
+
+    // 描画が間に合っているかで3D描画の解像度を決める
+    const float gpu_time = profiler.gpuFrameTime(profiler.latestFrame());
+    render_scale_.update(delta_time, (gpu_time >= 0.0f) ? gpu_time / 1000.0f : -1.0f);
+    
     {
       // 全オブジェクトへ更新指示
+      Profiler::Scope profile(profiler, "update");
       Signal::Params params;
       params.insert(Signal::Params::value_type("delta_time", fix_framerate_ ? float(1.0 / 60) : delta_time));
       fw_.signal().sendMessage(Msg::UPDATE, params);
@@ -202,9 +261,13 @@ public:
     {
       // ゲーム内オブジェクトの情報収集
       Signal::Params params;
-      fw_.signal().sendMessage(Msg::COLLECT_OBJECT_INFO, params);
+      {
+        Profiler::Scope profile(profiler, "collect");
+        fw_.signal().sendMessage(Msg::COLLECT_OBJECT_INFO, params);
+      }
 
       // ゲーム内オブジェクトの相互干渉
+      Profiler::Scope profile(profiler, "interference");
       fw_.signal().sendMessage(Msg::MUTUAL_INTERFERENCE, params);
     }
     
@@ -233,11 +296,30 @@ public:
       quake_camera_.update(delta_time);
     }
     
+#if defined (_DEBUG) || defined (USE_PROFILER)
+    char key = fw_.keyboard().getPushed();
+    // 処理時間の計測と表示
+    // TIPS:最適化した状態で計測できるよう、USE_PROFILERならRelease版でも有効
+    if (key == 'P') {
+      profile_view_.visible(!profile_view_.visible());
+#if !defined (USE_GPU_TIMER)
+      profiler.active(profile_view_.visible());
+#endif
+    }
+    if ((key == 'O') && profiler.active()) profiler.csv(profiler.csv() ? "" : fw_.savePath() + "profile.csv");
+#endif
+    
 #ifdef _DEBUG
     // テキストのみモード
-    char key = fw_.keyboard().getPushed();
     if (key == 'T') draw_text_only_ = !draw_text_only_;
     if (key == 't') draw_text_ = !draw_text_;
+    if (key == 'V') disp_visibility_ = !disp_visibility_;
+#if defined (USE_GL_RECORDER)
+    // OpenGLの呼び出しを記録(1フレーム)
+    if (key == 'K') fw_.glRecorder().start(1, false, fw_.savePath() + "gl_capture");
+    // ドライバへ渡さずにDRAWのCPU負荷だけを計る
+    if (key == 'N') fw_.glRecorder().start(300, true, fw_.savePath() + "gl_null");
+#endif
     
     if (key == 'G') gamecenter::deleteAchievements();
 #endif
@@ -254,19 +336,50 @@ public:
     setupProjectionMatrix();
     
     // 描画準備
+    // TIPS:3D描画は縮小したオフスクリーンバッファへ行う
     fw_.view().setupViewport();
+    render_scale_.begin(fw_.view().viewportSize());
     fw_.view().setupDraw();
     fw_.glState().depthTest(true);
     fw_.glState().cullFace(true);
 
     Signal::Params params;
 
-    text_prims_.vtxes.clear();
-    text_prims_.prims.clear();
+    text_prims_.clear();
     params.insert(Signal::Params::value_type("text_prims", &text_prims_));
+
+    shadow_prims_.clear();
+    params.insert(Signal::Params::value_type("shadow_prims", &shadow_prims_));
+
+    // 現在のカメラで可視判定の準備
+    visibility_.setup(getProjectionMatrix(), getModelMatrix(), planet_radius_);
+    params.insert(Signal::Params::value_type("visibility", &visibility_));
     
-    // 全オブジェクトへ描画指示
-    fw_.signal().sendMessage(Msg::DRAW, params);
+    Profiler& profiler = fw_.profiler();
+    {
+      // 全オブジェクトへ描画指示
+      Profiler::Scope profile(profiler, "draw", true);
+      fw_.signal().sendMessage(Msg::DRAW, params);
+    }
+
+    {
+      // 影をまとめて描画
+      Profiler::Scope profile(profiler, "shadow", true);
+      shadow_.draw(fw_, shadow_prims_);
+    }
+
+    // 画面へ拡大転送
+    // TIPS:テキストは元の解像度のまま描画する
+    {
+      Profiler::Scope profile(profiler, "blit", true);
+      render_scale_.end(fw_.glState(), *shader_holder_.read("blit"), fw_.view().viewportSize());
+    }
+
+#ifdef _DEBUG
+    if (disp_visibility_) {
+      DOUT << "drawn:" << visibility_.drawnNum() << " culled:" << visibility_.culledNum() << std::endl;
+    }
+#endif
 
 #ifdef _DEBUG
     if (draw_text_only_) {
@@ -276,7 +389,11 @@ public:
     if (!draw_text_) return;
 #endif
     
+    // 処理時間の表示
+    profile_view_.draw(text_prims_, fw_.view(), profiler, fw_.glState().counter());
+    
     // テキストを描画
+    Profiler::Scope profile(profiler, "text", true);
     drawTextPrim(text_prims_);
   }
 
@@ -305,7 +422,7 @@ public:
     case Msg::SPAWN_BASE:
       {
         auto obj = spawnObject<CubeBase>(fw_, objects_,
-                                         params_, model_holder_, shader_holder_, shadow_);
+                                         params_, model_holder_, shader_holder_);
 
         // 生成したオブジェクトにシグナル送信
         arguments.insert(Signal::Params::value_type("planet_radius", planet_radius_));
@@ -316,7 +433,7 @@ public:
     case Msg::SPAWN_PLAYER:
       {
         auto obj = spawnObject<CubePlayer>(fw_, objects_,
-                                           params_, camera_, model_holder_, shader_holder_, shadow_);
+                                           params_, camera_, model_holder_, shader_holder_);
       
         // 生成したオブジェクトにシグナル送信
         arguments.insert(Signal::Params::value_type("planet_radius", planet_radius_));
@@ -328,7 +445,7 @@ public:
       {
         const std::string& name = boost::any_cast<std::string&>(arguments.at("name"));
         auto obj = spawnObject<CubeEnemy>(fw_, objects_,
-                                          params_, name, cpu_factory_, model_holder_, shader_holder_, shadow_);
+                                          params_, name, cpu_factory_, model_holder_, shader_holder_);
 
         // 生成したオブジェクトにシグナル送信
         arguments.insert(Signal::Params::value_type("planet_radius", planet_radius_));
@@ -352,7 +469,7 @@ public:
     case Msg::SPAWN_ITEM:
       {
         auto obj = spawnObject<CubeItem>(fw_, objects_,
-                                         params_, model_holder_, shader_holder_, shadow_);
+                                         params_, model_holder_, shader_holder_);
 
         // 生成したオブジェクトにシグナル送信
         arguments.insert(Signal::Params::value_type("planet_radius", planet_radius_));
@@ -499,7 +616,7 @@ public:
 #endif
         {
           auto obj = spawnObject<AttackEffect>(fw_, objects_,
-                                               params_, shader_holder_, camera_);
+                                               params_, shader_holder_, camera_, attack_strip_);
           obj->message(Msg::SET_SPAWN_INFO, arguments);
         }
       }
@@ -656,14 +773,58 @@ private:
     }
   }
   
+  // 光源の寄与で特殊化するシェーダー
+  static const std::vector<std::string>& lightShaders() {
+    static const std::vector<std::string> names = {
+      "color_light_3",
+      "uirou_white",
+      "uirou_black",
+    };
+    return names;
+  }
+
+  // ゲーム中に切り替わる特殊化を先に作っておく
+  // TIPS:3つ目の光源は演出中だけ拡散光が入る
+  void prepareLightShaders() {
+    Light light_3 = lights_[2].second;
+    light_3.diffuse() = Vec3f::Zero();
+    const std::string normal = Light::defines(lights_[0].second, lights_[1].second, light_3);
+    light_3.diffuse() = Vec3f::Ones();
+    const std::string effect = Light::defines(lights_[0].second, lights_[1].second, light_3);
+
+    for (const auto& name : lightShaders()) {
+      shader_holder_.prepare(name, normal);
+      shader_holder_.prepare(name, effect);
+    }
+  }
+
   // まとめて光源を設定
   void setupLights() {
-    Light::setup(*shader_holder_.read("texture_light"), lights_[0].second);
-    Light::setup(*shader_holder_.read("uirou_rank"), lights_[0].second);
+    // 前回から変わっていなければ何もしない
+    bool changed = !lights_uploaded_;
+    for (u_int i = 0; i < ELEMSOF(lights_); ++i) {
+      if (lights_[i].second != uploaded_lights_[i]) changed = true;
+    }
+    if (!changed) return;
+
+    const auto& light_1 = lights_[0].second;
+    const auto& light_2 = lights_[1].second;
+    const auto& light_3 = lights_[2].second;
+    
+    Light::setup(*shader_holder_.read("texture_light"), light_1);
+    Light::setup(*shader_holder_.read("uirou_rank"), light_1);
+
+    // 寄与の無い光源の計算を省いた版に差し替える
+    const std::string defines = Light::defines(light_1, light_2, light_3);
+    for (const auto& name : lightShaders()) {
+      shader_holder_.specialize(name, defines);
+      Light::setup(*shader_holder_.read(name), light_1, light_2, light_3);
+    }
 
-    Light::setup(*shader_holder_.read("color_light_3"), lights_[0].second, lights_[1].second, lights_[2].second);
-    Light::setup(*shader_holder_.read("uirou_white"), lights_[0].second, lights_[1].second, lights_[2].second);
-    Light::setup(*shader_holder_.read("uirou_black"), lights_[0].second, lights_[1].second, lights_[2].second);
+    for (u_int i = 0; i < ELEMSOF(lights_); ++i) {
+      uploaded_lights_[i] = lights_[i].second;
+    }
+    lights_uploaded_ = true;
   }
 
   // 透視変換行列をまとめて設定
@@ -675,7 +836,8 @@ private:
       "uirou_white",
       "uirou_black",
       "uirou_rank",
-      "shadow"
+      "shadow",
+      "attack"
     };
 
     // 現在の透視変換行列
@@ -703,34 +865,87 @@ private:
     EasyShader& shader = *shader_holder_.read("font");
     shader();
 
-    // 頂点データをVBOへ転送
+    // 頂点データをリングバッファへ転送
     assert(text_prims.vtxes.size() < static_cast<size_t>(game_params_.at("font_vertex").get<double>()));
-		glBindBuffer(GL_ARRAY_BUFFER, font_vbo_.handle());
-		glBufferData(GL_ARRAY_BUFFER, sizeof(MatrixFont::Vtx) * text_prims.vtxes.size(), &text_prims.vtxes[0], GL_DYNAMIC_DRAW);
+    StreamBuffer& stream = fw_.streamBuffer();
+    GLintptr offset = 0;
+    if (!text_prims.vtxes.empty()) {
+      offset = stream.write(&text_prims.vtxes[0], sizeof(MatrixFont::Vtx) * text_prims.vtxes.size());
+    }
     
     // 頂点データ格納先を指示
     GLint position = shader.attrib("position");
     glEnableVertexAttribArray(position);
-    glVertexAttribPointer(position, 2, GL_FLOAT, GL_FALSE, sizeof(MatrixFont::Vtx), 0);
+    fw_.glState().arrayBuffer(stream.handle());
+    glVertexAttribPointer(position, 3, GL_SHORT, GL_FALSE, sizeof(MatrixFont::Vtx), StreamBuffer::pointer(offset));
 
+    // ドットの大きさをピクセルで求めるのに使う
+    Vec2f viewport_size = fw_.view().viewportSize();
+    glUniform2f(shader.uniform("viewport_size"), viewport_size.x(), viewport_size.y());
+    
     // 表示用行列を生成
     Mat4f model_projection = getProjectionMatrix() * getModelMatrix();
 
-    for (const auto& prim : text_prims.prims) {
-      // 表示行列
-      Mat4f m = model_projection * prim.matrix;
-      glUniformMatrix4fv(shader.uniform("modelViewProjectionMatrix"), 1, GL_FALSE, m.data());
-
-      // 表示色
-      glUniform4f(shader.uniform("material_diffuse"), prim.color(0), prim.color(1), prim.color(2), prim.color(3));
+    // PRIM_BATCH個ずつ行列と色をuniform配列へ転送して、まとめて描画
+    // キャッシュ済みのプリミティブは描画順を保つ為に、その都度割り込んで描画する
+    std::array<Mat4f, MatrixFont::PRIM_BATCH>  matrices;
+    std::array<GrpCol, MatrixFont::PRIM_BATCH> colors;
+    GLint   first  = 0;
+    GLsizei count  = 0;
+    size_t  remain = 0;
+    for (auto it = text_prims.prims.cbegin(); it != text_prims.prims.cend(); ++it) {
+      if (it->vbo) {
+        drawTextRange(first, count);
+        count = 0;
+        if (!it->num) continue;
+
+        Mat4f m = model_projection * it->matrix;
+        glUniformMatrix4fv(shader.uniform("cache_matrix"), 1, GL_FALSE, m.data());
+        glUniform4fv(shader.uniform("cache_color"), 1, it->color.data());
+
+        // 描画(頂点はキャッシュ済みのVBOを使う)
+        fw_.glState().arrayBuffer(it->vbo);
+        glVertexAttribPointer(position, 3, GL_SHORT, GL_FALSE, sizeof(MatrixFont::Vtx), 0);
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(it->num));
+
+        fw_.glState().arrayBuffer(stream.handle());
+        glVertexAttribPointer(position, 3, GL_SHORT, GL_FALSE, sizeof(MatrixFont::Vtx), StreamBuffer::pointer(offset));
+        continue;
+      }
+      
+      if (!remain) {
+        drawTextRange(first, count);
+        count = 0;
+
+        // 次のPRIM_BATCH個分をuniform配列へ転送
+        GLsizei num = 0;
+        for (auto p = it; (p != text_prims.prims.cend()) && (num < MatrixFont::PRIM_BATCH); ++p) {
+          if (p->vbo) continue;
+          matrices[num] = model_projection * p->matrix;
+          colors[num]   = p->color;
+          num += 1;
+        }
+        glUniformMatrix4fv(shader.uniform("prim_matrix"), num, GL_FALSE, matrices[0].data());
+        glUniform4fv(shader.uniform("prim_color"), num, colors[0].data());
+        remain = num;
+      }
 
-      // 描画(頂点はVBOのを使う)
-      glDrawArrays(GL_TRIANGLES, static_cast<GLsizei>(prim.index), static_cast<GLsizei>(prim.num));
+      // 連続した頂点はまとめて描画する
+      if (!count) first = static_cast<GLint>(it->index);
+      count = static_cast<GLsizei>(it->index + it->num - first);
+      remain -= 1;
     }
+    drawTextRange(first, count);
 
     // 後始末
     glDisableVertexAttribArray(position);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		fw_.glState().arrayBuffer(0);
+  }
+
+  // 頂点の範囲を指定してテキストを描画
+  static void drawTextRange(const GLint first, const GLsizei count) {
+    if (!count) return;
+    glDrawArrays(GL_POINTS, first, count);
   }
 
   // タイトル起動用のパラメータ生成
@@ -7,6 +7,7 @@
 
 #include "co_matrix.hpp"
 #include "co_easyShader.hpp"
+#include <string>
 
 
 namespace ngs {
@@ -45,6 +46,26 @@ public:
 
   Vec3f& specular() { return specular_; }
   const Vec3f specular() const { return specular_; }
+
+  bool operator==(const Light& rhs) const {
+    return (pos_ == rhs.pos_) && (ambient_ == rhs.ambient_)
+        && (diffuse_ == rhs.diffuse_) && (specular_ == rhs.specular_);
+  }
+
+  bool operator!=(const Light& rhs) const { return !(*this == rhs); }
+  
+
+  // ライティングx3のシェーダーを特殊化する#define
+  // 寄与が0の項は頂点シェーダーから取り除く
+  static std::string defines(const Light& light_1, const Light& light_2, const Light& light_3) {
+    std::string defines;
+    if (!light_1.specular().isZero()) defines += " SPECULAR_0";
+    if (!light_2.specular().isZero()) defines += " SPECULAR_1";
+    // TIPS:3つ目の光源は拡散光のみ使う
+    if (!light_3.diffuse().isZero())  defines += " LIGHT_2";
+
+    return defines.empty() ? defines : defines.substr(1);
+  }
   
 
   // 光源をシェーダーにセット
@@ -10,6 +10,8 @@
 #include <deque>
 #include <unordered_map>
 #include <picojson.h>
+#include "nn_vbo.hpp"
+#include "co_glState.hpp"
 
 
 namespace ngs {
@@ -72,9 +74,20 @@ class MatrixFont {
 
   
 public:
+  // 一度の描画でまとめるプリミティブの最大数
+  // TIPS:font.vshのuniform配列の要素数と一致させること
+  enum {
+    PRIM_BATCH = 16,
+    // キャッシュ済みの頂点データ用のスロット
+    CACHE_SLOT = PRIM_BATCH
+  };
+
   // 描画用の頂点の定義
+  // 1ドットにつき1頂点(左上の座標とプリミティブのスロット番号)
   struct Vtx {
-    GLfloat x, y;
+    GLshort x, y;
+    GLshort slot;
+    GLshort reserved;
   };
 
   
@@ -156,11 +169,93 @@ public:
     GrpCol color;
     size_t index;
     size_t num;
+    // 0:PrimPackの頂点を使う それ以外:キャッシュ済みのVBO
+    GLuint vbo;
   };
   
   struct PrimPack {
     std::vector<Vtx> vtxes;
     std::deque<Prim> prims;
+    // PrimPackの頂点を使うプリミティブの数
+    size_t stream_num;
+
+    PrimPack() :
+      stream_num(0)
+    {}
+
+    void clear() {
+      vtxes.clear();
+      prims.clear();
+      stream_num = 0;
+    }
+  };
+
+
+  // 生成済みの頂点データをGPU側に保持しておく
+  // 文字列と演出パラメータが前回と同じなら、頂点を作り直さずに使い回す
+  class TextCache {
+    Vbo vbo_;
+    GLsizei num_;
+
+    std::string text_;
+    int mix_;
+    int mix_increase_;
+
+    bool valid_;
+    bool built_;
+
+    
+  public:
+    TextCache() :
+      num_(0),
+      mix_(0),
+      mix_increase_(0),
+      valid_(false),
+      built_(false)
+    {}
+
+    // TIPS:コピーした場合は作り直す
+    TextCache(const TextCache& rhs) :
+      vbo_(rhs.vbo_),
+      num_(0),
+      mix_(0),
+      mix_increase_(0),
+      valid_(false),
+      built_(false)
+    {}
+
+    TextCache& operator=(const TextCache&) {
+      valid_ = false;
+      built_ = false;
+      return *this;
+    }
+
+    
+    // 前回と同じ内容か判定して、違っていれば記録し直す
+    bool check(const std::string& text, const int mix, const int mix_increase) {
+      if (valid_ && (mix == mix_) && (mix_increase == mix_increase_) && (text == text_)) return true;
+
+      text_         = text;
+      mix_          = mix;
+      mix_increase_ = mix_increase;
+      valid_ = true;
+      built_ = false;
+      return false;
+    }
+
+    bool built() const { return built_; }
+    GLuint handle() const { return vbo_.handle(); }
+    GLsizei num() const { return num_; }
+    
+    void build(const std::vector<Vtx>& vtxes) {
+      num_ = static_cast<GLsizei>(vtxes.size());
+      if (num_ > 0) {
+        gl_state.arrayBuffer(vbo_.handle());
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Vtx) * vtxes.size(), &vtxes[0], GL_STATIC_DRAW);
+        gl_state.arrayBuffer(0);
+      }
+      built_ = true;
+    }
   };
 
   
@@ -170,9 +265,80 @@ public:
     Prim prim = {
       matrix,
       color,
-      prim_pack.vtxes.size()
+      prim_pack.vtxes.size(),
+      0,
+      0
+    };
+
+    // まとめて描画する時のuniform配列の位置
+    GLshort slot = static_cast<GLshort>(prim_pack.stream_num % PRIM_BATCH);
+    createTextVtx(prim_pack.vtxes, text, mix, mix_increase, slot);
+    prim_pack.stream_num += 1;
+
+    // 生成した頂点数を記録
+    prim.num = prim_pack.vtxes.size() - prim.index;
+    prim_pack.prims.push_back(prim);
+  }
+
+  // 描画プリミティブを生成する(キャッシュ付き)
+  // 前のフレームと同じ内容が続いた時にVBOを作り、以降はそれを使う
+  void createTextPrim(PrimPack& prim_pack, TextCache& cache,
+                      const std::string& text, const Mat4f& matrix, const GrpCol& color,
+                      const int mix = 0, const int mix_increase = 0) const {
+    if (!cache.check(text, mix, mix_increase)) {
+      // 内容が変わったばかりなので、今回は毎フレーム生成する方で描画
+      createTextPrim(prim_pack, text, matrix, color, mix, mix_increase);
+      return;
+    }
+
+    if (!cache.built()) {
+      std::vector<Vtx> vtxes;
+      createTextVtx(vtxes, text, mix, mix_increase, CACHE_SLOT);
+      cache.build(vtxes);
+    }
+
+    Prim prim = {
+      matrix,
+      color,
+      0,
+      static_cast<size_t>(cache.num()),
+      cache.handle()
+    };
+    prim_pack.prims.push_back(prim);
+  }
+
+
+  // 任意のドットから描画プリミティブを生成する(グラフ表示など)
+  void createDotPrim(PrimPack& prim_pack, const std::vector<Vec2i>& dots, const Mat4f& matrix, const GrpCol& color) const {
+    Prim prim = {
+      matrix,
+      color,
+      prim_pack.vtxes.size(),
+      0,
+      0
     };
 
+    GLshort slot = static_cast<GLshort>(prim_pack.stream_num % PRIM_BATCH);
+    for (const auto& dot : dots) {
+      Vtx vtx = {
+        static_cast<GLshort>(dot.x()),
+        static_cast<GLshort>(dot.y()),
+        slot,
+        0
+      };
+      prim_pack.vtxes.push_back(vtx);
+    }
+    prim_pack.stream_num += 1;
+
+    prim.num = prim_pack.vtxes.size() - prim.index;
+    prim_pack.prims.push_back(prim);
+  }
+
+
+private:
+  // 文字列の頂点データ生成
+  void createTextVtx(std::vector<Vtx>& vtxes, const std::string& text, const int mix, const int mix_increase,
+                     const GLshort slot) const {
     // stringから一文字ごとに頂点データを生成
     float x = 0.0f;
     float y = 0.0f;
@@ -193,23 +359,18 @@ public:
       default:
         {
           const Body& body = bodies_.at(chara);
-          makeCharaPrim(prim_pack.vtxes, x, y + body.heightOffset(), body, std::max(mix_current, 0));
+          makeCharaPrim(vtxes, x, y + body.heightOffset(), body, std::max(mix_current, 0), slot);
           x += body.width() + 1.0f;
           mix_current += mix_increase;
         }
         break;
       }
     }
-
-    // 生成した頂点数を記録
-    prim.num = prim_pack.vtxes.size() - prim.index;
-    prim_pack.prims.push_back(prim);
   }
 
-
-private:
   // 一文字の頂点データ生成
-  void makeCharaPrim(std::vector<Vtx>& vtxes, const float start_x, const float start_y, const Body& body, const int mix) const {
+  void makeCharaPrim(std::vector<Vtx>& vtxes, const float start_x, const float start_y, const Body& body, const int mix,
+                     const GLshort slot) const {
     int width  = body.width();
     int height = body.height();
     const auto& bitmap = body.bitmap();
@@ -221,18 +382,14 @@ private:
       float x = (pixel.x() + mix_x) % width + start_x;
       float y = -((pixel.y() + mix_y / width) % height) + start_y;
       
-      // 一辺0.8な正方形を描画
-      Vtx vtx[] = {
-        { x,        y        },
-        { x + 0.8f, y        },
-        { x,        y - 0.8f },
-            
-        { x + 0.8f, y        },
-        { x,        y - 0.8f },
-        { x + 0.8f, y - 0.8f }
+      // 一辺0.8な正方形はシェーダーでポイントスプライトとして描画
+      Vtx vtx = {
+        static_cast<GLshort>(x),
+        static_cast<GLshort>(y),
+        slot,
+        0
       };
-      // コンテナの末尾にまとめて追加
-      vtxes.insert(vtxes.end(), vtx, &vtx[ELEMSOF(vtx)]);
+      vtxes.push_back(vtx);
 
       if (mix) {
         mix_x += mix;
@@ -8,6 +8,8 @@
 #include "co_defines.hpp"
 #include <string>
 #include <unordered_map>
+#include <memory>
+#include <vector>
 #include "co_matrix.hpp"
 #include "co_model.hpp"
 
@@ -15,13 +17,21 @@
 namespace ngs {
 
 class ModelHolder {
+  typedef std::shared_ptr<const ModelAsset> AssetPtr;
+  
   std::string path_;
-	std::unordered_map<std::string, Model> models_;
+	std::unordered_map<std::string, AssetPtr> models_;
+  // 全モデルでテクスチャを共有する
+  std::shared_ptr<TexMng> textures_;
+  // 全モデルで頂点バッファを共有する
+  std::shared_ptr<MeshBuffer> buffer_;
 
   
 public:
   explicit ModelHolder(const std::string& path) :
-    path_(path)
+    path_(path),
+    textures_(std::make_shared<TexMng>()),
+    buffer_(std::make_shared<MeshBuffer>())
   {
     DOUT << "ModelHolder()" << std::endl;
   }
@@ -31,17 +41,40 @@ public:
   }
 
   
-  // MaterialやNodeの情報は書き換える事があるので実体を返す
-  Model read(const std::string& name) {
-		auto it = models_.find(name);
+  // 表情テクスチャなどを1枚のアトラスにまとめる
+  // TIPS:モデルを読み込む前に呼ぶこと
+  void textureAtlas(const std::string& name, const std::vector<std::string>& files) {
+    assert(models_.empty());
+    std::vector<std::string> paths;
+    for (const auto& file : files) {
+      paths.push_back(path_ + file);
+    }
+    textures_->readAtlas(name, paths);
+  }
+
+  // 読み込んだデータは共有し、マテリアルの上書きなどはインスタンス側で持つ
+  // baked: 階層構造を焼き込み、マテリアルごとに1回で描画できるようにする
+  //        ノードの行列や表示を書き換えないモデルに指定する
+  Model read(const std::string& name, const bool baked = false) {
+    // TIPS:焼き込んだものは別のデータとして扱う
+    const std::string key = baked ? name + ":baked" : name;
+		auto it = models_.find(key);
 		if (it == models_.end()) {
       // まだ読み込んでないなら、読み込んでコンテナに格納する
-			DOUT << "Model read: " << name << std::endl;
-      // TIPS:引数が２つ以上あるクラスをemplaceする
-      it = models_.emplace_hint(it, std::piecewise_construct,
-                                    std::forward_as_tuple(name), std::forward_as_tuple(name, path_));
+			DOUT << "Model read: " << key << std::endl;
+      AssetPtr asset = std::make_shared<ModelAsset>(name, path_, textures_, buffer_, baked);
+      DOUT << "MeshBuffer:" << buffer_->bytes() << " bytes (shared:" << buffer_->sharedBytes() << " bytes)" << std::endl;
+
+      // TIPS:shared_ptrなので、emplaceでなくて構わない
+      it = models_.insert(std::unordered_map<std::string, AssetPtr>::value_type(key, asset)).first;
 		}
-    return it->second;
+    return Model(it->second);
+  }
+
+  // 読み込みが済んだら頂点バッファのCPU側の内容を破棄する
+  // TIPS:以降に読み込むモデルは確保済みの領域に収めること
+  void finish() {
+    buffer_->finish();
   }
 };
 
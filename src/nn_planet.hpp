@@ -40,7 +40,7 @@ public:
     active_(true),
     updated_(false),
     pause_(false),
-    model_(model_holder.read(params_.at("model").get<std::string>())),
+    model_(model_holder.read(params_.at("model").get<std::string>(), true)),
     shader_(shader_holder.read(params_.at("shader").get<std::string>())),
     scale_(planet_radius)
   {
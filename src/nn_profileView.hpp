@@ -0,0 +1,111 @@
+﻿
+#pragma once
+
+//
+// 処理時間の表示
+// 区間ごとの平均時間と、フレーム時間のグラフを画面左上に出す
+//
+
+#include "co_defines.hpp"
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <cctype>
+#include "co_profiler.hpp"
+#include "co_glState.hpp"
+#include "co_view.hpp"
+#include "nn_matrixFont.hpp"
+
+
+namespace ngs {
+
+class ProfileView {
+  enum {
+    // グラフの高さ(ドット)
+    GRAPH_HEIGHT = 24
+  };
+  
+  const MatrixFont& font_;
+  float scale_;
+  // グラフの上端の時間(ミリ秒)
+  float graph_ms_;
+  // 目標のフレーム時間(ミリ秒)
+  float budget_ms_;
+
+  std::vector<Vec2i> dots_;
+  bool visible_;
+
+  
+public:
+  ProfileView(const MatrixFont& font, const float scale, const float budget_ms) :
+    font_(font),
+    scale_(scale),
+    graph_ms_(budget_ms * 2.0f),
+    budget_ms_(budget_ms),
+    visible_(false)
+  {}
+
+
+  bool visible() const { return visible_; }
+  void visible(const bool visible) { visible_ = visible; }
+
+
+  void draw(MatrixFont::PrimPack& prim_pack, const View& view, const Profiler& profiler, const GlState::Counter& gl_counter) {
+    if (!visible_ || !profiler.active()) return;
+
+    const Vec2f pos = view.layoutPos(Vec2f(scale_ * 2.0f, -scale_ * 2.0f), View::Layout(View::TOP | View::LEFT));
+    Eigen::Affine3f m =
+      Eigen::Translation<float, 3>(Vec3f(std::floor(pos.x()), std::floor(pos.y()), 0.0f))
+      * Eigen::Scaling(Vec3f(scale_, scale_, 1.0f));
+
+    // フレーム時間のグラフ
+    {
+      dots_.clear();
+      const u_int latest = profiler.latestFrame();
+      for (u_int i = 0; i < Profiler::HISTORY; ++i) {
+        if (latest < i) break;
+
+        const float ms = profiler.frameTime(latest - i);
+        const int height = std::min(static_cast<int>(ms / graph_ms_ * GRAPH_HEIGHT + 0.5f), static_cast<int>(GRAPH_HEIGHT));
+        const int x = Profiler::HISTORY - 1 - i;
+        for (int y = 0; y < height; ++y) {
+          dots_.push_back(Vec2i(x, y - GRAPH_HEIGHT));
+        }
+      }
+      font_.createDotPrim(prim_pack, dots_, m.matrix(), GrpCol(0.4f, 0.9f, 0.4f, 1.0f));
+
+      // 目標の線
+      dots_.clear();
+      const int budget = static_cast<int>(budget_ms_ / graph_ms_ * GRAPH_HEIGHT + 0.5f);
+      for (int x = 0; x < Profiler::HISTORY; x += 2) {
+        dots_.push_back(Vec2i(x, budget - GRAPH_HEIGHT));
+      }
+      font_.createDotPrim(prim_pack, dots_, m.matrix(), GrpCol(1.0f, 0.3f, 0.3f, 1.0f));
+    }
+
+    // 区間ごとの平均
+    // TIPS:フォントに小文字がないので大文字にする
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(2);
+    text << "FRAME " << profiler.averageFrame() << "\n";
+    for (const auto& section : profiler.sections()) {
+      for (const char c : section.name) {
+        text << static_cast<char>(std::toupper(static_cast<u_char>(c)));
+      }
+      text << " " << profiler.averageCpu(section);
+      const float gpu = profiler.averageGpu(section);
+      if (gpu >= 0.0f) text << "/" << gpu;
+      text << "\n";
+    }
+    // OpenGLのステート変更の発行数/省いた数
+    text << "GL " << gl_counter.issued << "/" << gl_counter.filtered << "\n";
+    if (profiler.csv()) text << "CSV";
+
+    Eigen::Affine3f text_m = Eigen::Translation<float, 3>(Vec3f(0.0f, -(GRAPH_HEIGHT + 8) * scale_, 0.0f)) * m;
+    font_.createTextPrim(prim_pack, text.str(), text_m.matrix(), GrpCol(1.0f, 1.0f, 1.0f, 1.0f));
+  }
+  
+};
+
+}
@@ -0,0 +1,184 @@
+﻿
+#pragma once
+
+//
+// 描画解像度の自動調整
+// 3D描画をオフスクリーンバッファへ縮小して描き、画面へ拡大転送する
+// GPU時間が取れればそれで判断し、取れなければ(ES 2.0など)フレーム間隔で判断する
+//
+
+#include "co_defines.hpp"
+#include <memory>
+#include <algorithm>
+#include <vector>
+#include "co_json.hpp"
+#include "co_easyShader.hpp"
+#include "co_glState.hpp"
+#include "nn_fbo.hpp"
+#include "nn_staticMesh.hpp"
+
+
+namespace ngs {
+
+class RenderScale : private boost::noncopyable {
+  enum {
+    // 拡大を試すまでに待つ回数の上限
+    RAISE_WAIT_MAX = 16
+  };
+  
+  float min_;
+  float max_;
+  float step_;
+  // 目標のフレーム時間
+  float frame_time_;
+  // 判定する間隔(秒)
+  float interval_;
+
+  float scale_;
+  // 平滑化したフレーム時間
+  float average_;
+  float timer_;
+
+  // 拡大を試すまでに待つ回数
+  u_int raise_wait_;
+  u_int good_count_;
+  bool raised_;
+
+  std::unique_ptr<Fbo> fbo_;
+  // 画面全体を覆う四角形
+  StaticMesh quad_;
+  GLint framebuffer_;
+  Vec2i viewport_;
+
+  
+public:
+  explicit RenderScale(const picojson::value& params) :
+    min_(params.at("min").get<double>()),
+    max_(params.at("max").get<double>()),
+    step_(params.at("step").get<double>()),
+    frame_time_(params.at("frame_time").get<double>()),
+    interval_(params.at("interval").get<double>()),
+    scale_(max_),
+    average_(frame_time_),
+    timer_(0.0f),
+    raise_wait_(1),
+    good_count_(0),
+    raised_(false),
+    quad_(GL_TRIANGLE_STRIP, quad(), { { "position", 2 } }),
+    framebuffer_(0),
+    viewport_(Vec2i::Zero())
+  {
+    DOUT << "RenderScale()" << std::endl;
+  }
+
+  ~RenderScale() {
+    DOUT << "~RenderScale()" << std::endl;
+  }
+
+
+  float scale() const { return scale_; }
+  
+  // フレーム時間から縮小率を決める
+  // gpu_time: 1フレームのGPU時間(秒)。負なら取れていない
+  void update(const float delta_time, const float gpu_time = -1.0f) {
+    // TIPS:読み込みなどによる一時的な遅れは平均の2倍までに抑える
+    //      捨ててしまうと、常に遅い環境で一度も縮小しなくなる
+    const float sample = (gpu_time >= 0.0f) ? gpu_time : delta_time;
+    average_ = average_ * 0.9f + std::min(sample, average_ * 2.0f) * 0.1f;
+    timer_ += delta_time;
+    if (timer_ < interval_) return;
+    timer_ = 0.0f;
+
+    if (average_ > frame_time_ * 1.1f) {
+      // 間に合っていないので縮小する
+      // 直前に拡大して間に合わなくなった場合は、次に試すまで長く待つ
+      if (raised_) raise_wait_ = std::min(raise_wait_ * 2, static_cast<u_int>(RAISE_WAIT_MAX));
+      changeScale(scale_ - step_);
+      good_count_ = 0;
+      raised_     = false;
+      return;
+    }
+
+    if (raised_) {
+      // 拡大しても間に合っている
+      raise_wait_ = std::max(raise_wait_ / 2, 1u);
+      raised_     = false;
+    }
+    
+    // 間に合っている状態が続いたら拡大を試す
+    if (scale_ < max_) {
+      good_count_ += 1;
+      if (good_count_ >= raise_wait_) {
+        changeScale(scale_ + step_);
+        good_count_ = 0;
+        raised_     = true;
+      }
+    }
+  }
+
+  // 3D描画の開始
+  // size: 画面の大きさ(ピクセル)
+  void begin(const Vec2f& size) {
+    framebuffer_ = 0;
+    if (scale_ >= 1.0f) return;
+    
+    const Vec2i screen(static_cast<int>(size.x()), static_cast<int>(size.y()));
+    if (!fbo_ || (fbo_->size() != screen)) {
+      // TIPS:画面と同じ大きさで確保して、縮小率を変えても作り直さない
+      fbo_.reset(new Fbo(screen));
+    }
+
+    viewport_ = Vec2i(std::max(static_cast<int>(screen.x() * scale_), 1),
+                      std::max(static_cast<int>(screen.y() * scale_), 1));
+    framebuffer_ = fbo_->bind(viewport_);
+  }
+
+  // 3D描画の終了
+  // 画面へ拡大転送して、ビューポートを戻す
+  void end(GlState& gl_state, const EasyShader& shader, const Vec2f& size) {
+    if (scale_ >= 1.0f) return;
+
+    fbo_->unbind(framebuffer_);
+    gl_state.viewport(0, 0, size.x(), size.y());
+
+    gl_state.depthTest(false);
+    gl_state.cullFace(false);
+    gl_state.blend(false);
+
+    shader();
+    glUniform1i(shader.uniform("sampler"), 0);
+    glUniform2f(shader.uniform("uv_scale"),
+                float(viewport_.x()) / fbo_->size().x(),
+                float(viewport_.y()) / fbo_->size().y());
+    glUniform2f(shader.uniform("uv_max"),
+                (viewport_.x() - 0.5f) / fbo_->size().x(),
+                (viewport_.y() - 0.5f) / fbo_->size().y());
+    fbo_->bindTexture();
+
+    quad_.draw(shader);
+    gl_state.texture(0);
+  }
+
+  
+private:
+  static std::vector<GLfloat> quad() {
+    static const GLfloat vtx[] = {
+      -1.0f, -1.0f,
+       1.0f, -1.0f,
+      -1.0f,  1.0f,
+       1.0f,  1.0f,
+    };
+    return std::vector<GLfloat>(vtx, vtx + ELEMSOF(vtx));
+  }
+
+  void changeScale(const float scale) {
+    const float value = std::min(std::max(scale, min_), max_);
+    if (value == scale_) return;
+
+    DOUT << "RenderScale:" << scale_ << "->" << value << " frame:" << average_ << std::endl;
+    scale_ = value;
+  }
+  
+};
+
+}
@@ -18,12 +18,36 @@ class ShaderHolder : private boost::noncopyable {
   typedef std::shared_ptr<EasyShader> ShaderPtr;
   
   std::string path_;
+  std::string cache_path_;
 	std::unordered_map<std::string, ShaderPtr> shaders_;
 
+  // 特殊化した版の管理
+  struct Variants {
+    // 現在使われている#define
+    std::string current;
+    // 使われていない版
+    std::unordered_map<std::string, ShaderPtr> parked;
+  };
+  std::unordered_map<std::string, Variants> variants_;
+
+
+  ShaderPtr makeVariant(const std::string& name, const std::string& defines) const {
+    const auto packed = EasyShader::readPacked(path_ + name, defines);
+#ifdef _DEBUG
+    // 特殊化していないソースと演算量を比べる
+    u_int full_cost = EasyShader::aluEstimate(removeComment(EasyShader::readFile(path_ + name + ".vsh")));
+    DOUT << "Shader variant: " << name << " [" << defines << "]"
+         << " ALU:" << EasyShader::aluEstimate(packed.vsh) << "/" << full_cost << std::endl;
+#endif
+    return std::make_shared<EasyShader>(packed, cache_path_);
+  }
+
   
 public:
-  explicit ShaderHolder(const std::string& path) :
-    path_(path)
+  // cache_path: リンク済みプログラムのキャッシュを置く場所
+  ShaderHolder(const std::string& path, const std::string& cache_path) :
+    path_(path),
+    cache_path_(cache_path)
   {
     DOUT << "ShaderHolder()" << std::endl;
   }
@@ -42,7 +66,7 @@ public:
 
     // 新しく読み込んでキャッシュに登録
     DOUT << "Shader read: " << name << std::endl;
-    ShaderPtr shader = std::make_shared<EasyShader>(path_ + name);
+    ShaderPtr shader = std::make_shared<EasyShader>(EasyShader::readPacked(path_ + name), cache_path_);
 
     // TIPS:shared_ptrなので、emplaceでなくて構わない
     shaders_.insert(std::unordered_map<std::string, ShaderPtr>::value_type(name, shader));
@@ -50,6 +74,39 @@ public:
     return shader;
   }
   
+  // #defineで特殊化した版に差し替える
+  // TIPS:read()で返したshared_ptrの中身が入れ替わるので、使う側は何もしなくてよい
+  void specialize(const std::string& name, const std::string& defines) {
+    ShaderPtr shader = read(name);
+    auto& variants = variants_[name];
+    if (variants.current == defines) return;
+
+    ShaderPtr variant;
+    auto it = variants.parked.find(defines);
+    if (it != variants.parked.end()) {
+      variant = it->second;
+      variants.parked.erase(it);
+    }
+    else {
+      variant = makeVariant(name, defines);
+    }
+
+    // 差し替えた古い方を控えておく
+    shader->swap(*variant);
+    variants.parked.insert(std::unordered_map<std::string, ShaderPtr>::value_type(variants.current, variant));
+    variants.current = defines;
+  }
+
+  // 特殊化した版を先に作っておく
+  // TIPS:ゲーム中に初めてコンパイルするとGLES2のドライバでは目に見えて引っかかる
+  void prepare(const std::string& name, const std::string& defines) {
+    read(name);
+    auto& variants = variants_[name];
+    if ((variants.current == defines) || variants.parked.count(defines)) return;
+
+    variants.parked.insert(std::unordered_map<std::string, ShaderPtr>::value_type(defines, makeVariant(name, defines)));
+  }
+  
   std::shared_ptr<EasyShader> get(const std::string& name) const {
 		const auto it = shaders_.find(name);
     if (it != shaders_.cend()) {
@@ -7,6 +7,7 @@
 
 #include "co_random.hpp"
 #include "co_modelDraw.hpp"
+#include "nn_visibility.hpp"
 
 
 namespace ngs {
@@ -20,6 +21,8 @@ class Signt : public ObjBase {
   bool pause_;
 
   Model model_;
+  // 可視判定用の境界球
+  SphereVolume bounds_;
   std::shared_ptr<EasyShader> shader_;
 
   // 識別用ハッシュ値
@@ -58,6 +61,7 @@ public:
     updated_(false),
     pause_(false),
     model_(model_holder.read(params_.at("model").get<std::string>())),
+    bounds_(Visibility::boundingSphere(model_)),
     shader_(shader_holder.read(params_.at("shader").get<std::string>())),
     scale_(params_.at("scale").get<double>()),
     y_pos_(200.0f),
@@ -157,6 +161,10 @@ private:
   void draw(const Signal::Params& arguments) {
     if (!updated_) return;
 
+    // 惑星の裏側や画面外にあるものは描画しない
+    auto visibility = boost::any_cast<Visibility*>(arguments.at("visibility"));
+    if (!visibility->isVisible(bounds_, model_matrix_.matrix())) return;
+    
     modelDraw(model_, model_matrix_.matrix(), *shader_, false);
   }
 
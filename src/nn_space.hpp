@@ -40,7 +40,7 @@ public:
     active_(true),
     updated_(false),
     pause_(false),
-    model_(model_holder.read(params_.at("model").get<std::string>())),
+    model_(model_holder.read(params_.at("model").get<std::string>(), true)),
     shader_(shader_holder.read(params_.at("shader").get<std::string>())),
     rotate_vec_(randomVector<Vec3f>()),
     rotate_speed_(deg2rad(randomValue(vectFromJson<Vec2f>(params_.at("rotate_speed"))))),
@@ -111,8 +111,8 @@ private:
     fw_.glState().depthTest(false);
     fw_.glState().blend(true);
 
-    glBlendEquation(GL_FUNC_ADD);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    fw_.glState().blendEquation(GL_FUNC_ADD);
+    fw_.glState().blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     pushMatrix();
     loadIdentity();
@@ -0,0 +1,95 @@
+﻿
+#pragma once
+
+//
+// 変化しない小さな頂点データ
+// 生成時に一度だけVBOへ転送し、描画はGPU側のメモリから行う
+// TIPS:クライアント側の頂点配列は毎回ドライバがコピーする上、ES3やCore Profileでは使えない
+//
+
+#include "co_defines.hpp"
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "co_easyShader.hpp"
+#include "co_glState.hpp"
+#include "nn_vbo.hpp"
+
+
+namespace ngs {
+
+class StaticMesh : private boost::noncopyable {
+public:
+  // 頂点属性(float限定)
+  struct Attrib {
+    const char* name;
+    GLint size;
+  };
+
+
+private:
+  struct Layout {
+    std::string name;
+    GLint size;
+    GLsizei offset;
+  };
+
+  Vbo vbo_;
+  GLenum mode_;
+  GLsizei count_;
+  GLsizei stride_;
+  std::vector<Layout> layouts_;
+
+
+public:
+  // vertex: 頂点ごとにattribsの順で属性を並べた配列
+  StaticMesh(const GLenum mode, const std::vector<GLfloat>& vertex, const std::vector<Attrib>& attribs) :
+    mode_(mode),
+    count_(0),
+    stride_(0)
+  {
+    DOUT << "StaticMesh()" << std::endl;
+
+    for (const auto& attrib : attribs) {
+      Layout layout = { attrib.name, attrib.size, stride_ };
+      layouts_.push_back(layout);
+      stride_ += static_cast<GLsizei>(attrib.size * sizeof(GLfloat));
+    }
+    assert(stride_ > 0);
+    count_ = static_cast<GLsizei>(vertex.size() * sizeof(GLfloat) / stride_);
+
+    gl_state.arrayBuffer(vbo_.handle());
+    glBufferData(GL_ARRAY_BUFFER, count_ * stride_, vertex.empty() ? 0 : &vertex[0], GL_STATIC_DRAW);
+    gl_state.arrayBuffer(0);
+  }
+
+  ~StaticMesh() {
+    DOUT << "~StaticMesh()" << std::endl;
+  }
+
+
+  GLsizei count() const { return count_; }
+
+  // TIPS:シェーダーは呼び出し側で有効にしておく
+  void draw(const EasyShader& shader) const {
+    gl_state.arrayBuffer(vbo_.handle());
+    for (const auto& layout : layouts_) {
+      const GLint location = shader.attrib(layout.name);
+      if (location < 0) continue;
+
+      glEnableVertexAttribArray(location);
+      glVertexAttribPointer(location, layout.size, GL_FLOAT, GL_FALSE, stride_, reinterpret_cast<const GLvoid*>(static_cast<size_t>(layout.offset)));
+    }
+
+    glDrawArrays(mode_, 0, count_);
+
+    for (const auto& layout : layouts_) {
+      const GLint location = shader.attrib(layout.name);
+      if (location >= 0) glDisableVertexAttribArray(location);
+    }
+    gl_state.arrayBuffer(0);
+  }
+
+};
+
+}
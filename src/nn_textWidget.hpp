@@ -41,6 +41,9 @@ private:
   bool recalc_pos_;
   bool recalc_size_;
 
+  // 頂点データのキャッシュ
+  MatrixFont::TextCache cache_;
+
 
 public:
   TextWidget(const MatrixFont& font,
@@ -148,7 +151,8 @@ public:
       * Eigen::Scaling(Vec3f(scale_, scale_, 1.0f));
 
     // 描画プリミティブ生成
-    font_.createTextPrim(prim_pack, text_, m.matrix(), col, mix, mix_increase);
+    // TIPS:文字列と演出パラメータが変わらなければキャッシュ済みの頂点を使う
+    font_.createTextPrim(prim_pack, cache_, text_, m.matrix(), col, mix, mix_increase);
   }
   
 private:
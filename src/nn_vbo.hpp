@@ -7,6 +7,7 @@
 //
 
 #include <boost/noncopyable.hpp>
+#include "co_glState.hpp"
 
 
 namespace ngs {
@@ -20,16 +21,22 @@ public:
   }
   
   ~Vbo() {
-		glDeleteBuffers(1, &handle_);
+		gl_state.deleteBuffer(handle_);
   }
 
   // TIPS:自分でコピーする
-  Vbo(const Vbo& rhs) {
+  //      中身はコピーしないので、使う側で作り直す
+  Vbo(const Vbo&) {
     DOUT << "Vbo(const Vbo& rhs)" << std::endl;
 
     glGenBuffers(1, &handle_);
   }
 
+  // TIPS:ハンドルを共有すると二重に削除されるので、自分のものを使い続ける
+  Vbo& operator=(const Vbo&) {
+    return *this;
+  }
+
   
   GLuint handle() const { return handle_; }
 
@@ -0,0 +1,119 @@
+﻿
+#pragma once
+
+//
+// 可視判定
+// 惑星の裏側に隠れるものと、画面外のものを描画前に省く
+//
+
+#include "co_defines.hpp"
+#include <algorithm>
+#include "co_vector.hpp"
+#include "co_collision.hpp"
+#include "co_model.hpp"
+
+
+namespace ngs {
+
+class Visibility {
+  // 世界座標でのカメラ位置
+  Vec3f eye_;
+  float planet_radius_;
+
+  // 視錐台の6平面(法線は内向き)
+  Vec4f planes_[6];
+
+  u_int drawn_num_;
+  u_int culled_num_;
+
+  
+public:
+  Visibility() :
+    eye_(Vec3f::Zero()),
+    planet_radius_(0.0f),
+    drawn_num_(0),
+    culled_num_(0)
+  {}
+
+  
+  // 毎フレーム描画前にカメラの行列から準備する
+  void setup(const Mat4f& projection, const Mat4f& model, const float planet_radius) {
+    // カメラ行列の逆変換でカメラ位置を求める
+    Vec4f eye = model.inverse() * Vec4f(0.0f, 0.0f, 0.0f, 1.0f);
+    eye_ = eye.head<3>() / eye.w();
+
+    planet_radius_ = planet_radius;
+
+    // 透視変換行列×カメラ行列から視錐台の平面を抽出
+    Mat4f m = projection * model;
+    for (int i = 0; i < 3; ++i) {
+      planes_[i * 2]     = m.row(3) + m.row(i);
+      planes_[i * 2 + 1] = m.row(3) - m.row(i);
+    }
+    for (auto& plane : planes_) {
+      plane /= plane.head<3>().norm();
+    }
+
+    drawn_num_  = 0;
+    culled_num_ = 0;
+  }
+
+  // 球が見えるか判定して、描画数と省いた数を数える
+  bool isVisible(const Vec3f& center, const float radius) {
+    bool visible = !isBehindHorizon(center, radius) && isInFrustum(center, radius);
+    if (visible) drawn_num_  += 1;
+    else         culled_num_ += 1;
+    return visible;
+  }
+
+  // モデル座標系の境界球を行列で変換して判定
+  bool isVisible(const SphereVolume& volume, const Mat4f& matrix) {
+    Vec4f center = matrix * Vec4f(volume.point.x(), volume.point.y(), volume.point.z(), 1.0f);
+    float scale  = std::max(matrix.col(0).head<3>().norm(),
+                            std::max(matrix.col(1).head<3>().norm(), matrix.col(2).head<3>().norm()));
+    return isVisible(center.head<3>(), volume.radius * scale);
+  }
+
+  u_int drawnNum() const { return drawn_num_; }
+  u_int culledNum() const { return culled_num_; }
+
+  
+  // Modelの全Meshを含む境界球
+  // TIPS:ModelAssetが読み込み時に求めたものを使う(生成の度に計算しない)
+  static SphereVolume boundingSphere(const Model& model) {
+    const ModelAsset& asset = model.asset();
+    SphereVolume res = {
+      asset.center(),
+      asset.radius()
+    };
+    return res;
+  }
+  
+
+private:
+  // 惑星の裏側に完全に隠れているか判定
+  // TIPS:惑星を半径ぶん小さくして中心点で判定すれば、球全体が隠れている時だけ真になる
+  bool isBehindHorizon(const Vec3f& center, const float radius) const {
+    float occluder_radius = planet_radius_ - radius;
+    if (occluder_radius <= 0.0f) return false;
+
+    // カメラから惑星への接線が作る円錐の外側なら見えている
+    float eye_dist_sq = eye_.squaredNorm() - occluder_radius * occluder_radius;
+    if (eye_dist_sq <= 0.0f) return false;
+    
+    Vec3f v = center - eye_;
+    float v_dot_c = -v.dot(eye_);
+    return (v_dot_c > eye_dist_sq) && ((v_dot_c * v_dot_c / v.squaredNorm()) > eye_dist_sq);
+  }
+
+  // 視錐台と交差しているか判定
+  bool isInFrustum(const Vec3f& center, const float radius) const {
+    for (const auto& plane : planes_) {
+      if ((plane.head<3>().dot(center) + plane.w()) < -radius) return false;
+    }
+    return true;
+  }
+  
+};
+
+}
@@ -0,0 +1,104 @@
+﻿//
+// OpenGL呼び出しの再生ツール
+// GlRecorderで記録したファイルを読み込み、全フレームをN回発行して時間を計る
+//
+// replay <記録ファイル(.bin)> [回数]
+// ビルドは make -f replay.mk
+//
+// TIPS:ソフトウェアラスタライザで計る場合はMesaのllvmpipeを使う
+//      LIBGL_ALWAYS_SOFTWARE=1 GALLIUM_DRIVER=llvmpipe replay gl_capture.bin 100
+//
+
+#include "co_defines.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+
+// OpenGL関連のインクルードは順番がある…
+#if defined (_MSC_VER)
+#include <windows.h>
+#include <GL/glew.h>
+#elif !defined (__APPLE__)
+// Linux(Mesa):拡張関数はプロトタイプ宣言を有効にして直接呼ぶ
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/glfw.h>
+#if defined (__APPLE__)
+#include <OpenGL/glext.h>
+#elif !defined (_MSC_VER)
+#include <GL/glext.h>
+#endif
+#include "co_glExt.hpp"
+#include "co_glReplayer.hpp"
+
+
+int main(int argc, char* argv[]) {
+  using namespace ngs;
+
+  if (argc < 2) {
+    std::cout << "usage: replay <capture.bin> [count]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const int count = (argc > 2) ? std::max(std::atoi(argv[2]), 1) : 100;
+
+  if (glfwInit() != GL_TRUE) return EXIT_FAILURE;
+
+  int result = EXIT_FAILURE;
+  {
+    GlReplayer replayer;
+    if (!replayer.read(argv[1])) {
+      std::cout << "can't read " << argv[1] << std::endl;
+      glfwTerminate();
+      return EXIT_FAILURE;
+    }
+
+    // 記録した時と同じ大きさで作る
+    GLint box[4] = { 0, 0, 960, 640 };
+    replayer.viewport(box);
+    if ((glfwOpenWindow(box[2], box[3], 0, 0, 0, 0, 24, 0, GLFW_WINDOW) != GL_TRUE) || !initGlExt()) {
+      std::cout << "can't open window" << std::endl;
+      glfwTerminate();
+      return EXIT_FAILURE;
+    }
+    // 画面の更新を待たない
+    glfwSwapInterval(0);
+
+    std::cout << glGetString(GL_RENDERER) << std::endl;
+    replayer.setup();
+    glFinish();
+
+    // 1回目はドライバの準備が入るので除く
+    replayer.replay();
+    glFinish();
+
+    std::vector<double> times;
+    for (int i = 0; i < count; ++i) {
+      const double start = glfwGetTime();
+      replayer.replay();
+      glFinish();
+      times.push_back((glfwGetTime() - start) * 1000.0);
+    }
+    glfwSwapBuffers();
+
+    std::sort(times.begin(), times.end());
+    double total = 0.0;
+    for (const double time : times) total += time;
+
+    const u_int frames = std::max(replayer.frames(), 1u);
+    std::cout << std::fixed << std::setprecision(3)
+              << replayer.frames() << " frames x " << count << "\n"
+              << "ms/frame avg " << total / times.size() / frames
+              << " median " << times[times.size() / 2] / frames
+              << " min " << times.front() / frames
+              << " max " << times.back() / frames << std::endl;
+
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR) std::cout << "GL error 0x" << std::hex << error << std::endl;
+    result = EXIT_SUCCESS;
+  }
+
+  glfwTerminate();
+  return result;
+}